@@ -14,27 +14,118 @@
 #include <time.h>
 #include <mpi.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <getopt.h>
 #include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "wordUtils.h"
+#include "simdUtils.h"
 
 #define CLOCK_MONOTONIC 1 // for clock_gettime
+#define CHUNK_TAG 0 // messages with a chunk (or chunk range) or with the results of a chunk
+#define END_TAG 1 // empty message that tells a worker there is no more work
+#define SHARE(next, end) (((uint64_t)(next) << 32) | (uint64_t)(end)) // share of chunks [next, end) of a process with work stealing, in one word
+#define SHARE_NEXT(share) ((share) >> 32)
+#define SHARE_END(share) ((share) & 0xFFFFFFFFu)
+#define MAX_STEALING_CHUNKS 0xFFFFFFFFu // chunks of the input with work stealing (indices fit in half a word)
+#define MAX_CHUNK_SEGMENTS 32 // files (or parts of files) packed into one chunk, so small files do not cost a message each
+#define BUFFER_POOL_SIZE 16 // maximum number of chunk buffers of the dispatcher (buffers are reused once their sends complete)
+#define ADAPTIVE_SMOOTHING 0.25 // weight of the last chunk in the average times of the adaptive chunk size
+#define ADAPTIVE_MAX_WAIT_RATIO 0.10 // the adaptive chunk size doubles if workers wait for chunks longer than this fraction of the processing time
+#define ADAPTIVE_MIN_WAIT_RATIO 0.01 // the adaptive chunk size halves if workers wait for chunks shorter than this fraction of the processing time
+#define ADAPTIVE_TAIL_CHUNKS 2 // near the end of the input, the adaptive chunk size leaves this many chunks for each slot
 
 
 /** \brief Structure that represents the final results of each file */
 typedef struct {
     char *fileName;
-    int nWords;
-    int nWordsWMultCons;
+    int64_t nWords;
+    int64_t nWordsWMultCons;
     FILE *fp;
+    chunk_summary summary; // merged summary of the chunks processed so far, in order
+    chunk_summary *chunkSummaries; // summaries of the chunks processed before the chunks preceding them (ring indexed by chunk % capacity)
+    bool *received; // whether each chunk has been processed (ring indexed by chunk % capacity)
+    int64_t nChunks; // number of chunks sent
+    int64_t nMerged; // number of chunks merged into summary
+    int capacity; // capacity of chunkSummaries and received, at least the number of chunks sent and not merged
 } final_file_results;
 
-/** \brief Structure that represents the results of a processed chunk */
+/** \brief Structure that represents the size of a file, to send the chunks of the largest files first */
 typedef struct {
-    int nWords;
-    int nWordsWMultCons;
+    int fileId;
+    int64_t size;
+} file_size;
+
+/** \brief Structure that represents a pool of chunk buffers, each reused once the send that uses it completes */
+typedef struct {
+    int nBuffers;
+    char **buffers;
+    int *sizes; // bytes of each buffer (buffers grow with the chunk size)
+    MPI_Request *requests; // send that uses each buffer (MPI_REQUEST_NULL if the buffer is free)
+} buffer_pool;
+
+/** \brief Structure that represents the bytes of a file in a chunk sent to a worker */
+typedef struct {
+    int fileId; // file of the bytes, whose counts the worker accumulates
+    int length;
+} chunk_segment;
+
+/** \brief Structure that represents a chunk sent to a worker, made of the bytes of one or more files (only the bytes used are sent) */
+typedef struct {
+    int nSegments;
+    chunk_segment segments[MAX_CHUNK_SEGMENTS]; // segments of the chunk, in the order of their bytes
+    char chunk[]; // bytes of the segments (up to the maximum chunk size)
+} chunk_message;
+
+/** \brief Structure that represents the partial words of a processed segment (followed by the head and tail bytes) */
+typedef struct {
+    bool hasDelimiter;
+    int headLength;
+    int tailLength;
+} segment_results;
+
+/** \brief Structure that represents the partial words of a processed chunk (its counts are accumulated in the worker, and only the partial words used are sent) */
+typedef struct {
+    double computeTime; // time the worker took to read (if needed) and process the chunk
+    double waitTime; // time the worker waited for the chunk
+    int nSegments;
+    char segments[]; // segment_results of each segment, followed by its head and tail (up to the maximum chunk size in total)
 } partial_results;
 
+/** \brief Structure that represents the options of the distribution of chunks (set in the dispatcher and broadcast to the workers) */
+typedef struct {
+    bool sendRanges; // true if the dispatcher sends chunk ranges and the workers read the chunks
+    bool sharedInput; // true if the input is loaded once into a shared memory window and the workers process the chunk ranges in place
+    int prefetchDepth; // number of chunks sent to each worker before receiving its results
+    int chunkSize; // bytes of each chunk (initial size if adaptive)
+    bool adaptive; // true if the chunk size adapts to the time workers wait for chunks
+    bool staticPartition; // true if every process (no dispatcher) processes its own share of the input
+    bool workStealing; // true if every process (no dispatcher) processes its own share of the input, and steals from other shares when idle
+    bool rmaQueue; // true if every process takes chunk descriptors from a queue exposed by the process 0 in a window (no dispatcher)
+} dispatch_options;
+
+/** \brief Structure that represents the partial words of consecutive bytes of a file processed by a process (followed by the head and tail bytes) */
+typedef struct {
+    int fileId;
+    int64_t offset; // offset of the first byte (in the input or in the file), which orders the shares of a file
+    bool hasDelimiter;
+    int headLength;
+    int tailLength;
+} share_summary;
+
+/** \brief MPI datatype of a chunk_range (created in main) */
+static MPI_Datatype chunkRangeType = MPI_DATATYPE_NULL;
+
+/** \brief Long options of the program */
+static const struct option long_options[] = {
+    {"static", no_argument, NULL, 'S'},
+    {"steal", no_argument, NULL, 'W'},
+    {"rma", no_argument, NULL, 'R'},
+    {NULL, 0, NULL, 0},
+};
+
 /**
  *  \brief Gets the time elapsed since the last call to this function.
  *
@@ -54,168 +145,1190 @@ static double get_delta_time(void) {
 }
 
 /**
- * \brief Dispatcher lifecycle:
- * - Receive work requests from workers
- * - Send chunks to workers
- * - Receive chunk results from workers
- * - Update final results of each file
+ * \brief Allocates a buffer for a chunk or its results, or aborts if there is not enough memory.
+ *
+ * \param size number of bytes of the buffer
+ *
+ * \return the buffer
+ */
+static void *allocateChunkBuffer(size_t size) {
+    void *buffer = malloc(size);
+
+    if (buffer == NULL) {
+        fprintf(stderr, "Could not allocate memory for a chunk of %zu bytes\n", size);
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+    return buffer;
+}
+
+/**
+ * \brief Creates the MPI datatype of a chunk_range, with the extent of the structure so that arrays of ranges can be sent.
+ *
+ * \return the committed datatype
+ */
+static MPI_Datatype createChunkRangeType(void) {
+    int blockLengths[] = {1, 1, 1, 1};
+    MPI_Aint displacements[] = {
+        offsetof(chunk_range, fileId),
+        offsetof(chunk_range, length),
+        offsetof(chunk_range, offset),
+        offsetof(chunk_range, finished)
+    };
+    MPI_Datatype types[] = {MPI_INT, MPI_INT, MPI_INT64_T, MPI_C_BOOL};
+    MPI_Datatype structType, rangeType;
+
+    MPI_Type_create_struct(4, blockLengths, displacements, types, &structType);
+    MPI_Type_create_resized(structType, 0, sizeof(chunk_range), &rangeType);
+    MPI_Type_commit(&rangeType);
+    MPI_Type_free(&structType);
+    return rangeType;
+}
+
+/**
+ * \brief Returns the maximum size of a chunk, which sets the size of the chunk and results buffers.
+ *
+ * It is at most MAX_CHUNK_SIZE (-c is bounded by it), so the sizes of the buffers and messages do not overflow an int.
+ *
+ * \param options options of the distribution of chunks
+ */
+static int maxChunkSize(const dispatch_options *options) {
+    return options->adaptive ? MAX_ADAPTIVE_CHUNK_SIZE : options->chunkSize;
+}
+
+/**
+ * \brief Adapts the chunk size to the time workers wait for chunks (dispatch latency) compared to the time they process them.
+ *
+ * The chunk size doubles while the latency is exposed, and halves while it is well hidden (smaller chunks balance the load better).
+ * It changes at most once per nSlots results, so the results of the chunks sent with the new size are seen before changing it again.
+ *
+ * \param chunkSize current chunk size
+ * \param results results of the last processed chunk
+ * \param nSlots number of chunks that can be in flight
+ *
+ * \return new chunk size
+ */
+static int adaptChunkSize(int chunkSize, const partial_results *results, int nSlots) {
+    static double avgWaitTime = 0, avgComputeTime = 0;
+    static int nResults = 0;
+
+    avgWaitTime = ADAPTIVE_SMOOTHING * results->waitTime + (1 - ADAPTIVE_SMOOTHING) * avgWaitTime;
+    avgComputeTime = ADAPTIVE_SMOOTHING * results->computeTime + (1 - ADAPTIVE_SMOOTHING) * avgComputeTime;
+    if (++nResults < nSlots) {
+        return chunkSize;
+    }
+
+    if (avgWaitTime > ADAPTIVE_MAX_WAIT_RATIO * avgComputeTime && chunkSize <= MAX_ADAPTIVE_CHUNK_SIZE / 2) {
+        chunkSize *= 2;
+        nResults = 0;
+    } else if (avgWaitTime < ADAPTIVE_MIN_WAIT_RATIO * avgComputeTime && chunkSize >= 2 * MIN_ADAPTIVE_CHUNK_SIZE) {
+        chunkSize /= 2;
+        nResults = 0;
+    }
+    return chunkSize;
+}
+
+/**
+ * \brief Assigns the next chunk of a file to a worker.
+ *
+ * \param fileData results of the file
+ *
+ * \return index of the chunk in the file
+ */
+static int64_t newChunk(final_file_results *fileData) {
+    // the ring only holds the chunks not merged yet, and grows if there are more
+    if (fileData->nChunks - fileData->nMerged == fileData->capacity) {
+        int capacity = fileData->capacity == 0 ? 16 : 2 * fileData->capacity;
+        chunk_summary *chunkSummaries = (chunk_summary *)malloc(capacity * sizeof(chunk_summary));
+        bool *received = (bool *)malloc(capacity * sizeof(bool));
+
+        for (int64_t i = fileData->nMerged; i < fileData->nChunks; i++) {
+            chunkSummaries[i % capacity] = fileData->chunkSummaries[i % fileData->capacity];
+            received[i % capacity] = fileData->received[i % fileData->capacity];
+        }
+        free(fileData->chunkSummaries);
+        free(fileData->received);
+        fileData->chunkSummaries = chunkSummaries;
+        fileData->received = received;
+        fileData->capacity = capacity;
+    }
+    fileData->received[fileData->nChunks % fileData->capacity] = false;
+    return fileData->nChunks++;
+}
+
+/**
+ * \brief Compares two files by decreasing size, and then by their order in the command line (for qsort).
+ */
+static int compareFileSizes(const void *a, const void *b) {
+    const file_size *fileA = (const file_size *)a;
+    const file_size *fileB = (const file_size *)b;
+
+    if (fileA->size != fileB->size) {
+        return (fileA->size < fileB->size) - (fileA->size > fileB->size);
+    }
+    return fileA->fileId - fileB->fileId;
+}
+
+/**
+ * \brief Opens a file in the dispatcher, if it is not open yet.
+ *
+ * \param fileData results of the file
+ */
+static void openFile(final_file_results *fileData) {
+    if (fileData->fp == NULL) {
+        if ((fileData->fp = fopen(fileData->fileName, "rb")) == NULL) {
+            perror("Error opening file");
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+    }
+}
+
+/**
+ * \brief Initializes a pool of chunk buffers (buffers are allocated when first used).
+ *
+ * \param pool pool of buffers
+ * \param nBuffers number of buffers
+ */
+static void initializeBufferPool(buffer_pool *pool, int nBuffers) {
+    pool->nBuffers = nBuffers;
+    pool->buffers = (char **)malloc(nBuffers * sizeof(char *));
+    pool->sizes = (int *)malloc(nBuffers * sizeof(int));
+    pool->requests = (MPI_Request *)malloc(nBuffers * sizeof(MPI_Request));
+    for (int i = 0; i < nBuffers; i++) {
+        pool->buffers[i] = NULL;
+        pool->sizes[i] = 0;
+        pool->requests[i] = MPI_REQUEST_NULL;
+    }
+}
+
+/**
+ * \brief Takes a free buffer from a pool, waiting for a send to complete if all buffers are in use.
+ *
+ * The send that uses the buffer must be stored in pool->requests[buffer].
+ *
+ * \param pool pool of buffers
+ * \param size minimum number of bytes of the buffer
+ *
+ * \return index of the buffer
+ */
+static int acquireBuffer(buffer_pool *pool, int size) {
+    int buffer = -1;
+
+    for (int i = 0; i < pool->nBuffers && buffer < 0; i++) {
+        if (pool->requests[i] == MPI_REQUEST_NULL) {
+            buffer = i;
+        }
+    }
+    if (buffer < 0) {
+        MPI_Waitany(pool->nBuffers, pool->requests, &buffer, MPI_STATUS_IGNORE);
+    }
+
+    if (pool->sizes[buffer] < size) {
+        pool->sizes[buffer] = size;
+        free(pool->buffers[buffer]);
+        pool->buffers[buffer] = (char *)allocateChunkBuffer(size * sizeof(char));
+    }
+    return buffer;
+}
+
+/**
+ * \brief Waits for the sends that use the buffers of a pool and frees them.
+ *
+ * \param pool pool of buffers
+ */
+static void freeBufferPool(buffer_pool *pool) {
+    MPI_Waitall(pool->nBuffers, pool->requests, MPI_STATUSES_IGNORE);
+    for (int i = 0; i < pool->nBuffers; i++) {
+        free(pool->buffers[i]);
+    }
+    free(pool->buffers);
+    free(pool->sizes);
+    free(pool->requests);
+}
+
+/**
+ * \brief Adds the results of a segment of a chunk to the results of its file.
+ *
+ * Summaries are merged in the order of the chunks, so the words split between chunks are counted once.
+ * The summaries of chunks processed before the chunks preceding them are kept until these arrive.
+ *
+ * \param fileData results of the file
+ * \param chunkId index of the chunk (segment) in the file
+ * \param segment results of the segment (segment_results followed by head and tail)
+ *
+ * \return number of bytes of the results of the segment.
+ */
+static int addChunkResults(final_file_results *fileData, int64_t chunkId, char *segment) {
+    segment_results results;
+    memcpy(&results, segment, sizeof(segment_results));
+    chunk_summary summary = {
+        .nWords = 0, // in the counts of the workers
+        .nWordsWMultCons = 0,
+        .hasDelimiter = results.hasDelimiter,
+        .headLength = results.headLength,
+        .tailLength = results.tailLength,
+        .head = segment + sizeof(segment_results),
+        .tail = segment + sizeof(segment_results) + results.headLength
+    };
+
+    // copy the summary, merging it into an empty one
+    memset(&fileData->chunkSummaries[chunkId % fileData->capacity], 0, sizeof(chunk_summary));
+    mergeChunkSummaries(&fileData->chunkSummaries[chunkId % fileData->capacity], &summary);
+    fileData->received[chunkId % fileData->capacity] = true;
+
+    while (fileData->nMerged < fileData->nChunks && fileData->received[fileData->nMerged % fileData->capacity]) {
+        chunk_summary *next = &fileData->chunkSummaries[fileData->nMerged % fileData->capacity];
+        mergeChunkSummaries(&fileData->summary, next);
+        free(next->head);
+        free(next->tail);
+        fileData->nMerged++;
+    }
+    return sizeof(segment_results) + results.headLength + results.tailLength;
+}
+
+/**
+ * \brief Summarizes a chunk cut at any byte: finds its partial words and counts the words between them.
+ *
+ * \param chunk Array of characters (chunk).
+ * \param chunkSize Number of bytes of the chunk.
+ * \param fileCounts Words and words with equal consonants of the file of the chunk, where the counts of the chunk are added.
+ * \param segment Where the results of the chunk will be stored (segment_results followed by head and tail).
+ *
+ * \return number of bytes of the results of the chunk.
+ */
+static int summarizeChunk(const char *chunk, int chunkSize, int64_t *fileCounts, char *segment) {
+    chunk_summary summary;
+    segment_results results;
+
+    findChunkEnds(chunk, chunkSize, &summary);
+    countWordsSimd(chunk + summary.headLength, chunkSize - summary.headLength - summary.tailLength, &summary.nWords, &summary.nWordsWMultCons);
+
+    fileCounts[0] += summary.nWords;
+    fileCounts[1] += summary.nWordsWMultCons;
+    results.hasDelimiter = summary.hasDelimiter;
+    results.headLength = summary.headLength;
+    results.tailLength = summary.tailLength;
+    memcpy(segment, &results, sizeof(segment_results));
+    memcpy(segment + sizeof(segment_results), summary.head, summary.headLength);
+    memcpy(segment + sizeof(segment_results) + summary.headLength, summary.tail, summary.tailLength);
+
+    return sizeof(segment_results) + summary.headLength + summary.tailLength;
+}
+
+/**
+ * \brief Dispatcher lifecycle (each worker is handled as soon as its results arrive):
+ * - Order the files from the largest to the smallest
+ * - Send prefetchDepth chunks to each worker
+ * - Wait for the results of any worker
+ * - Merge the partial words of the chunks into the final results of each file
+ * - Adapt the chunk size (if adaptive)
+ * - Send the next chunk to that worker, or tell it to finish
+ * - Add the counts of the workers, combined with a reduction
  * 
  * \param finalFileData array with final results of each file
  * \param nProcesses number of processes (including the dispatcher)
  * \param nFiles number of files
+ * \param options options of the distribution of chunks
  */
-void distributeChunks(final_file_results *finalFileData, int nProcesses, int nFiles) {
+void distributeChunks(final_file_results *finalFileData, int nProcesses, int nFiles, const dispatch_options *options) {
     int size = nProcesses - 1; // number of worker processes
-    int currentFile = 0;
-    int numFinishedWorkers = 0;
+    int prefetchDepth = options->prefetchDepth;
+    bool sendRanges = options->sendRanges;
+    int nSlots = size * prefetchDepth; // chunks that can be in flight, prefetchDepth per worker
+    int currentFile; // file whose chunks are being sent (nFiles once all are sent)
+    int nextFile = 0; // position of the current file in fileOrder
+    file_size fileOrder[nFiles]; // files from the largest to the smallest, the order their chunks are sent in
+    int nStartedSlots = 0;
+    int chunkSize = options->chunkSize; // size of the next chunks (without the end of the input)
+    int sentSize; // size of the chunk sent
+    int usedSize; // bytes of the segments of the chunk being packed
+    int64_t remainingBytes = 0; // bytes of the input not sent yet
+    struct stat fileStat;
 
-    int workerRank;
+    int worker; // index of the worker being handled (rank - 1)
+    int slot; // index of the chunk being handled, in [0, nSlots), worker * prefetchDepth + i
     chunk_data chunkData; // chunk data to be sent to workers
-    partial_results recvData[size]; // partial results received from workers
-    bool allMsgRec, recVal, msgRec[size], finished[size]; // flags to control message reception and worker status
-    MPI_Request reqAskForWork[size], reqSendLength[size], reqSendChunk[size], reqRecvResults[size]; // MPI requests
-    int workerCurrentFile[size]; // array to store the current file being processed by each worker
+    chunk_message *message; // chunk and its segments, in a buffer of the pool
+    char *segment; // results of a segment of a chunk
+    int64_t counts[2 * nFiles], totalCounts[2 * nFiles]; // words and words with equal consonants of each file (counted in the workers)
+    int buffer; // index of the buffer of the chunk in the pool
+    buffer_pool pool; // buffers of the chunks sent to workers
+    chunk_range *chunkRanges = (chunk_range *)malloc(nSlots * sizeof(chunk_range)); // chunk ranges sent to workers (kept until the sends complete)
+    MPI_Request *reqSendChunk = (MPI_Request *)malloc(nSlots * sizeof(MPI_Request)); // MPI requests of the chunk ranges and ends of work
+    int *slotSegments = (int *)malloc(nSlots * sizeof(int)); // number of segments of the chunk in each slot
+    int *slotFile = (int *)malloc(nSlots * MAX_CHUNK_SEGMENTS * sizeof(int)); // file of each segment of the chunk in each slot
+    int64_t *slotChunk = (int64_t *)malloc(nSlots * MAX_CHUNK_SEGMENTS * sizeof(int64_t)); // index (in its file) of each segment of the chunk in each slot
+    int resultsCapacity = sizeof(partial_results) + MAX_CHUNK_SEGMENTS * sizeof(segment_results) + maxChunkSize(options); // bytes of the largest results
+    partial_results *recvData[size]; // partial results received from workers
+    MPI_Request reqRecvResults[size]; // MPI requests of the results
+    int nextResultSlot[size]; // slot of the next results of each worker (workers process their chunks in order)
+    int nInFlight[size]; // number of chunks sent to each worker whose results have not arrived
+    bool endSent[size]; // whether each worker was told to finish
 
-    // initialize the status of workers
+    initializeBufferPool(&pool, sendRanges ? 0 : (nSlots < BUFFER_POOL_SIZE ? nSlots : BUFFER_POOL_SIZE));
+    for (int i = 0; i < nSlots; i++) {
+        reqSendChunk[i] = MPI_REQUEST_NULL;
+    }
     for (int i = 0; i < size; i++) {
-        finished[i] = false;
+        recvData[i] = (partial_results *)allocateChunkBuffer(resultsCapacity);
+        reqRecvResults[i] = MPI_REQUEST_NULL;
+        nextResultSlot[i] = i * prefetchDepth;
+        nInFlight[i] = 0;
+        endSent[i] = false;
     }
 
-    while (numFinishedWorkers < size) {
-        // receive work requests from workers
-        for (int i = 1; i < nProcesses; i++) {
-            MPI_Irecv(&workerRank, 1, MPI_INT, i, 0, MPI_COMM_WORLD, &reqAskForWork[i - 1]);
-            msgRec[i-1] = false;
+    // the largest files are sent first, so the end of the input is made of the small files (and small chunks) that balance the finish of the workers
+    for (int i = 0; i < nFiles; i++) {
+        if (stat(finalFileData[i].fileName, &fileStat) != 0) {
+            perror("Error opening file");
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
         }
+        fileOrder[i].fileId = i;
+        fileOrder[i].size = fileStat.st_size;
+        remainingBytes += fileStat.st_size; // the adaptive chunk size shrinks near the end of the input
+    }
+    qsort(fileOrder, nFiles, sizeof(file_size), compareFileSizes);
+    currentFile = nFiles > 0 ? fileOrder[0].fileId : nFiles;
 
-        // test if the dispatcher has received a request from all workers
-        // for each requester, send a chunk
-        do {
-            allMsgRec = true;
-            for (int i = 1; i < nProcesses; i++) {
-                if (!msgRec[i-1]) {
-                    recVal = false;
-                    MPI_Test(&reqAskForWork[i - 1], (int *)&recVal, MPI_STATUS_IGNORE);
-                    if (recVal) {
-                        msgRec[i-1] = true;
-                        chunkData.chunk = (char *)malloc((MAX_CHUNK_SIZE + 1) * sizeof(char)); // +1 for null terminator
-                        chunkData.chunkSize = 0;
-
-                        if (currentFile == nFiles) {
-                            MPI_Isend(&chunkData.chunkSize, 1, MPI_INT, i, 0, MPI_COMM_WORLD, &reqSendLength[i - 1]);
-                            numFinishedWorkers++;
-                            finished[i-1] = true;
-                            continue;
-                        }
+    while (true) {
+        if (nStartedSlots < nSlots) {
+            // the first chunks of each worker are sent without waiting for results, one per worker at a time
+            worker = nStartedSlots % size;
+            slot = worker * prefetchDepth + nStartedSlots / size;
+            nStartedSlots++;
+        } else {
+            // results of a worker are also its request for the next chunk
+            MPI_Waitany(size, reqRecvResults, &worker, MPI_STATUS_IGNORE);
+            if (worker == MPI_UNDEFINED) {
+                break; // all workers finished
+            }
+            slot = nextResultSlot[worker];
+            nextResultSlot[worker] = (slot + 1) % prefetchDepth == 0 ? slot + 1 - prefetchDepth : slot + 1;
+            nInFlight[worker]--;
+            segment = recvData[worker]->segments;
+            for (int i = slot * MAX_CHUNK_SEGMENTS; i < slot * MAX_CHUNK_SEGMENTS + slotSegments[slot]; i++) {
+                segment += addChunkResults(&finalFileData[slotFile[i]], slotChunk[i], segment);
+            }
+            if (options->adaptive) {
+                chunkSize = adaptChunkSize(chunkSize, recvData[worker], nSlots);
+            }
+        }
 
-                        if (finalFileData[currentFile].fp == NULL) {
-                            if ((finalFileData[currentFile].fp = fopen(finalFileData[currentFile].fileName, "rb")) == NULL) {
-                                perror("Error opening file");
-                                exit(EXIT_FAILURE);
-                            }
-                        }
+        // the previous chunk range of the slot has been received, so it can be reused
+        MPI_Wait(&reqSendChunk[slot], MPI_STATUS_IGNORE);
 
-                        workerCurrentFile[i-1] = currentFile;
+        if (currentFile == nFiles) {
+            if (!endSent[worker]) {
+                MPI_Isend(NULL, 0, MPI_BYTE, worker + 1, END_TAG, MPI_COMM_WORLD, &reqSendChunk[slot]);
+                endSent[worker] = true;
+            }
+        } else {
+            // near the end of the input, leave chunks for all the slots so the workers finish together
+            sentSize = chunkSize;
+            if (options->adaptive && remainingBytes / (ADAPTIVE_TAIL_CHUNKS * nSlots) < sentSize) {
+                sentSize = remainingBytes / (ADAPTIVE_TAIL_CHUNKS * nSlots);
+                sentSize = sentSize < MIN_ADAPTIVE_CHUNK_SIZE ? MIN_ADAPTIVE_CHUNK_SIZE : sentSize;
+            }
 
-                        retrieveData(finalFileData[currentFile].fp, &chunkData);
-                        if (chunkData.finished) {
-                            fclose(finalFileData[currentFile].fp);
-                            currentFile++;
-                        }
+            if (sendRanges) {
+                // send chunk range to worker, which reads the chunk itself
+                openFile(&finalFileData[currentFile]);
+                slotSegments[slot] = 1;
+                slotFile[slot * MAX_CHUNK_SEGMENTS] = currentFile;
+                slotChunk[slot * MAX_CHUNK_SEGMENTS] = newChunk(&finalFileData[currentFile]);
+                chunkRanges[slot].fileId = currentFile;
+                retrieveRange(finalFileData[currentFile].fp, &chunkRanges[slot], sentSize);
+                remainingBytes -= chunkRanges[slot].length;
+                MPI_Isend(&chunkRanges[slot], 1, chunkRangeType, worker + 1, CHUNK_TAG, MPI_COMM_WORLD, &reqSendChunk[slot]);
 
-                        // send chunk to worker
-                        MPI_Isend(&chunkData.chunkSize, 1, MPI_INT, i, 0, MPI_COMM_WORLD, &reqSendLength[i - 1]);
-                        MPI_Isend(chunkData.chunk, chunkData.chunkSize, MPI_CHAR, i, 0, MPI_COMM_WORLD, &reqSendChunk[i - 1]);
+                if (chunkRanges[slot].finished) {
+                    fclose(finalFileData[currentFile].fp);
+                    currentFile = ++nextFile < nFiles ? fileOrder[nextFile].fileId : nFiles;
+                }
+            } else {
+                // send chunk to worker, packing the end of a file with the next files while the chunk has room (the size of the chunk is the size of the message)
+                buffer = acquireBuffer(&pool, sizeof(chunk_message) + sentSize + 1); // +1 for null terminator
+                message = (chunk_message *)pool.buffers[buffer];
+                message->nSegments = 0;
+                usedSize = 0;
+                do {
+                    openFile(&finalFileData[currentFile]);
+                    slotFile[slot * MAX_CHUNK_SEGMENTS + message->nSegments] = currentFile;
+                    slotChunk[slot * MAX_CHUNK_SEGMENTS + message->nSegments] = newChunk(&finalFileData[currentFile]);
+                    chunkData.chunk = message->chunk + usedSize;
+                    retrieveData(finalFileData[currentFile].fp, &chunkData, sentSize - usedSize);
+                    message->segments[message->nSegments].fileId = currentFile;
+                    message->segments[message->nSegments].length = chunkData.chunkSize;
+                    message->nSegments++;
+                    usedSize += chunkData.chunkSize;
 
-                        memset(chunkData.chunk, 0, MAX_CHUNK_SIZE);
-                        chunkData.chunkSize = 0; // reset chunk size
-                    } else {
-                        allMsgRec = false;
+                    if (chunkData.finished) {
+                        fclose(finalFileData[currentFile].fp);
+                        currentFile = ++nextFile < nFiles ? fileOrder[nextFile].fileId : nFiles;
                     }
+                } while (chunkData.finished && usedSize < sentSize && currentFile < nFiles && message->nSegments < MAX_CHUNK_SEGMENTS);
+                slotSegments[slot] = message->nSegments;
+                remainingBytes -= usedSize;
+                MPI_Isend(message, sizeof(chunk_message) + usedSize, MPI_BYTE, worker + 1, CHUNK_TAG, MPI_COMM_WORLD, &pool.requests[buffer]);
+            }
+            nInFlight[worker]++;
+        }
+
+        // receive the next results of the worker
+        if (nInFlight[worker] > 0 && reqRecvResults[worker] == MPI_REQUEST_NULL) {
+            MPI_Irecv(recvData[worker], resultsCapacity, MPI_BYTE, worker + 1, CHUNK_TAG, MPI_COMM_WORLD, &reqRecvResults[worker]);
+        }
+    }
+
+    // wait for the workers to receive the end of work
+    MPI_Waitall(nSlots, reqSendChunk, MPI_STATUSES_IGNORE);
+    freeBufferPool(&pool);
+
+    memset(counts, 0, sizeof(counts));
+    MPI_Reduce(counts, totalCounts, 2 * nFiles, MPI_INT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    // count the words at the start and end of each file
+    for (int i = 0; i < nFiles; i++) {
+        finalFileData[i].nWords += totalCounts[2 * i];
+        finalFileData[i].nWordsWMultCons += totalCounts[2 * i + 1];
+        finishChunkSummary(&finalFileData[i].summary, &finalFileData[i].nWords, &finalFileData[i].nWordsWMultCons);
+        free(finalFileData[i].chunkSummaries);
+        free(finalFileData[i].received);
+    }
+    for (int i = 0; i < size; i++) {
+        free(recvData[i]);
+    }
+    free(chunkRanges);
+    free(reqSendChunk);
+    free(slotSegments);
+    free(slotFile);
+    free(slotChunk);
+}
+
+/**
+ * \brief Worker lifecycle (prefetchDepth chunks are received while the current one is processed):
+ * - Receive chunk and its segments (bytes of each file) from the dispatcher (or the end of work)
+ * - Process each segment, adding its counts to the counts of its file
+ * - Send partial words back to the dispatcher, which also asks for more work
+ * - Send the counts of each file to the dispatcher with a reduction
+ *
+ * \param nFiles number of files
+ * \param options options of the distribution of chunks
+ */
+void workerRoutine(int nFiles, const dispatch_options *options) {
+    int prefetchDepth = options->prefetchDepth;
+    int capacity = maxChunkSize(options);
+    int chunkSize, resultsSize, position;
+    chunk_message *chunks[prefetchDepth]; // ring of receive buffers
+    int64_t counts[2 * nFiles]; // words and words with equal consonants of each file
+    MPI_Request reqRecvChunk[prefetchDepth];
+    MPI_Status status;
+    double t0, t1, t2;
+
+    partial_results *partialResults = (partial_results *)allocateChunkBuffer(sizeof(partial_results) + MAX_CHUNK_SEGMENTS * sizeof(segment_results) + capacity);
+
+    memset(counts, 0, sizeof(counts));
+    for (int i = 0; i < prefetchDepth; i++) {
+        chunks[i] = (chunk_message *)allocateChunkBuffer(sizeof(chunk_message) + capacity + 1);
+        MPI_Irecv(chunks[i], sizeof(chunk_message) + capacity, MPI_BYTE, 0, MPI_ANY_TAG, MPI_COMM_WORLD, &reqRecvChunk[i]);
+    }
+
+    t0 = MPI_Wtime();
+    for (int i = 0; ; i = (i + 1) % prefetchDepth) {
+        // receive chunk (or the end of work)
+        MPI_Wait(&reqRecvChunk[i], &status);
+
+        if (status.MPI_TAG == END_TAG) {
+            break;
+        }
+
+        t1 = MPI_Wtime();
+        MPI_Get_count(&status, MPI_BYTE, &chunkSize);
+        chunkSize -= sizeof(chunk_message);
+        chunks[i]->chunk[chunkSize] = '\0';
+
+        partialResults->nSegments = chunks[i]->nSegments;
+        resultsSize = offsetof(partial_results, segments);
+        position = 0;
+        for (int j = 0; j < chunks[i]->nSegments; j++) {
+            chunk_segment *segment = &chunks[i]->segments[j];
+            resultsSize += summarizeChunk(chunks[i]->chunk + position, segment->length, &counts[2 * segment->fileId], (char *)partialResults + resultsSize);
+            position += segment->length;
+        }
+        t2 = MPI_Wtime();
+        partialResults->waitTime = t1 - t0;
+        partialResults->computeTime = t2 - t1;
+
+        // the results ask for the next chunk, so its receive is posted first (the chunk is not needed anymore)
+        MPI_Irecv(chunks[i], sizeof(chunk_message) + capacity, MPI_BYTE, 0, MPI_ANY_TAG, MPI_COMM_WORLD, &reqRecvChunk[i]);
+
+        // send back partial results
+        MPI_Send(partialResults, resultsSize, MPI_BYTE, 0, CHUNK_TAG, MPI_COMM_WORLD);
+        t0 = MPI_Wtime();
+    }
+
+    // the other receives will not be matched
+    for (int i = 0; i < prefetchDepth; i++) {
+        if (reqRecvChunk[i] != MPI_REQUEST_NULL) {
+            MPI_Cancel(&reqRecvChunk[i]);
+            MPI_Wait(&reqRecvChunk[i], MPI_STATUS_IGNORE);
+        }
+        free(chunks[i]);
+    }
+    free(partialResults);
+
+    MPI_Reduce(counts, NULL, 2 * nFiles, MPI_INT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+}
+
+/**
+ * \brief Worker lifecycle when the dispatcher sends chunk ranges (prefetchDepth ranges are received while the current chunk is processed):
+ * - Receive chunk range from the dispatcher (or the end of work)
+ * - Read chunk from the file (or find it in the shared input)
+ * - Process chunk, adding its counts to the counts of its file
+ * - Send partial words back to the dispatcher, which also asks for more work
+ * - Send the counts of each file to the dispatcher with a reduction
+ * 
+ * \param fileNames array with the names of the files
+ * \param nFiles number of files
+ * \param sharedFiles bytes of each file in the shared input (NULL if the chunks are read from the files)
+ * \param options options of the distribution of chunks
+ */
+void workerRangeRoutine(char **fileNames, int nFiles, char **sharedFiles, const dispatch_options *options) {
+    int prefetchDepth = options->prefetchDepth;
+    int capacity = maxChunkSize(options);
+    chunk_range chunkRanges[prefetchDepth]; // ring of receive buffers
+    MPI_Request reqRecvRange[prefetchDepth];
+    MPI_Status status;
+    int resultsSize;
+    char *chunk = (char *)allocateChunkBuffer((capacity + 1) * sizeof(char));
+    int fileDescriptors[nFiles]; // files are opened when their first chunk arrives
+    int64_t counts[2 * nFiles]; // words and words with equal consonants of each file
+    double t0, t1, t2;
+
+    partial_results *partialResults = (partial_results *)allocateChunkBuffer(sizeof(partial_results) + sizeof(segment_results) + capacity);
+
+    memset(counts, 0, sizeof(counts));
+    for (int i = 0; i < nFiles; i++) {
+        fileDescriptors[i] = -1;
+    }
+    for (int i = 0; i < prefetchDepth; i++) {
+        MPI_Irecv(&chunkRanges[i], 1, chunkRangeType, 0, MPI_ANY_TAG, MPI_COMM_WORLD, &reqRecvRange[i]);
+    }
+
+    t0 = MPI_Wtime();
+    for (int i = 0; ; i = (i + 1) % prefetchDepth) {
+        // receive chunk range (or the end of work)
+        MPI_Wait(&reqRecvRange[i], &status);
+
+        if (status.MPI_TAG == END_TAG) {
+            break;
+        }
+
+        t1 = MPI_Wtime();
+        chunk_range *chunkRange = &chunkRanges[i];
+        if (sharedFiles != NULL) {
+            // the chunk is processed in place (other workers process the bytes around it)
+            resultsSize = summarizeChunk(sharedFiles[chunkRange->fileId] + chunkRange->offset, chunkRange->length, &counts[2 * chunkRange->fileId], partialResults->segments);
+        } else {
+            if (fileDescriptors[chunkRange->fileId] < 0) {
+                if ((fileDescriptors[chunkRange->fileId] = open(fileNames[chunkRange->fileId], O_RDONLY)) < 0) {
+                    perror("Error opening file");
+                    MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
                 }
             }
-        } while (!allMsgRec && numFinishedWorkers < size);
 
-        // receive results from all active workers
-        for (int i = 1; i < nProcesses; i++) {
-            if (finished[i-1]) continue;
-            MPI_Irecv(&recvData[i-1], sizeof(partial_results), MPI_BYTE, i, 0, MPI_COMM_WORLD, &reqRecvResults[i - 1]);
-            msgRec[i-1] = false;
+            if (pread(fileDescriptors[chunkRange->fileId], chunk, chunkRange->length, chunkRange->offset) != chunkRange->length) {
+                perror("Error reading file");
+                MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+            }
+
+            chunk[chunkRange->length] = '\0';
+
+            resultsSize = summarizeChunk(chunk, chunkRange->length, &counts[2 * chunkRange->fileId], partialResults->segments);
         }
+        partialResults->nSegments = 1;
+        resultsSize += offsetof(partial_results, segments);
+        t2 = MPI_Wtime();
+        partialResults->waitTime = t1 - t0;
+        partialResults->computeTime = t2 - t1;
 
-        // test if the dispatcher has received results from all workers and update final results
-        do {
-            allMsgRec = true;
-            for (int i = 1; i < nProcesses; i++) {
-                if (finished[i-1]) continue;
-                if (!msgRec[i-1]) {
-                    recVal = false;
-                    MPI_Test(&reqRecvResults[i - 1], (int *)&recVal, MPI_STATUS_IGNORE);
-                    if (recVal) {
-                        finalFileData[workerCurrentFile[i-1]].nWords += recvData[i-1].nWords;
-                        finalFileData[workerCurrentFile[i-1]].nWordsWMultCons += recvData[i-1].nWordsWMultCons;
-                        // printf("Dispatcher: worker %d has new results for file %s\n", i, finalFileData[workerCurrentFile[i-1]].fileName);
-                        msgRec[i-1] = true;
-                    } else {
-                        allMsgRec = false;
-                    }
+        // the results ask for the next chunk range, so its receive is posted first (the range is not needed anymore)
+        MPI_Irecv(&chunkRanges[i], 1, chunkRangeType, 0, MPI_ANY_TAG, MPI_COMM_WORLD, &reqRecvRange[i]);
+
+        // send back partial results
+        MPI_Send(partialResults, resultsSize, MPI_BYTE, 0, CHUNK_TAG, MPI_COMM_WORLD);
+        t0 = MPI_Wtime();
+    }
+
+    // the other receives will not be matched
+    for (int i = 0; i < prefetchDepth; i++) {
+        if (reqRecvRange[i] != MPI_REQUEST_NULL) {
+            MPI_Cancel(&reqRecvRange[i]);
+            MPI_Wait(&reqRecvRange[i], MPI_STATUS_IGNORE);
+        }
+    }
+    for (int i = 0; i < nFiles; i++) {
+        if (fileDescriptors[i] >= 0) {
+            close(fileDescriptors[i]);
+        }
+    }
+    free(chunk);
+    free(partialResults);
+
+    MPI_Reduce(counts, NULL, 2 * nFiles, MPI_INT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+}
+
+/**
+ * \brief Gets the sizes of the files in the process 0 and broadcasts them, so all processes use the same sizes.
+ *
+ * \param fileNames array with the names of the files
+ * \param nFiles number of files
+ * \param fileSizes where the sizes of the files will be stored
+ * \param rank process rank
+ *
+ * \return total size of the files
+ */
+static int64_t broadcastFileSizes(char **fileNames, int nFiles, int64_t *fileSizes, int rank) {
+    struct stat fileStat;
+    int64_t totalSize = 0;
+
+    if (rank == 0) {
+        for (int i = 0; i < nFiles; i++) {
+            if (stat(fileNames[i], &fileStat) != 0) {
+                perror("Error opening file");
+                MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+            }
+            fileSizes[i] = fileStat.st_size;
+        }
+    }
+    MPI_Bcast(fileSizes, nFiles, MPI_INT64_T, 0, MPI_COMM_WORLD);
+
+    for (int i = 0; i < nFiles; i++) {
+        totalSize += fileSizes[i];
+    }
+    return totalSize;
+}
+
+/**
+ * \brief Loads the files once into a shared memory window of the process 0, which the other processes map (all processes must be in the same node).
+ *
+ * \param fileNames array with the names of the files
+ * \param nFiles number of files
+ * \param rank process rank
+ * \param win where the window will be stored (freed with MPI_Win_free)
+ *
+ * \return array with the bytes of each file in the window
+ */
+static char **loadSharedInput(char **fileNames, int nFiles, int rank, MPI_Win *win) {
+    MPI_Comm nodeComm;
+    int nodeSize, worldSize;
+    int64_t fileSizes[nFiles];
+    int64_t totalSize;
+    MPI_Aint segmentSize;
+    int dispUnit;
+    char *input;
+    char **sharedFiles = (char **)malloc((nFiles + 1) * sizeof(char *));
+
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &nodeComm);
+    MPI_Comm_size(nodeComm, &nodeSize);
+    MPI_Comm_size(MPI_COMM_WORLD, &worldSize);
+    if (nodeSize != worldSize) {
+        if (rank == 0) {
+            fprintf(stderr, "Shared input requires all processes in the same node\n");
+        }
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+
+    totalSize = broadcastFileSizes(fileNames, nFiles, fileSizes, rank);
+    MPI_Win_allocate_shared(rank == 0 ? totalSize : 0, 1, MPI_INFO_NULL, nodeComm, &input, win);
+    MPI_Win_shared_query(*win, 0, &segmentSize, &dispUnit, &input);
+    MPI_Comm_free(&nodeComm);
+
+    sharedFiles[0] = input;
+    for (int i = 0; i < nFiles; i++) {
+        sharedFiles[i + 1] = sharedFiles[i] + fileSizes[i];
+    }
+
+    if (rank == 0) {
+        for (int i = 0; i < nFiles; i++) {
+            int fd = open(fileNames[i], O_RDONLY);
+            if (fd < 0) {
+                perror("Error opening file");
+                MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+            }
+            for (int64_t pos = 0; pos < fileSizes[i]; ) {
+                ssize_t nRead = read(fd, sharedFiles[i] + pos, fileSizes[i] - pos);
+                if (nRead <= 0) {
+                    perror("Error reading file");
+                    MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
                 }
+                pos += nRead;
             }
-        } while (!allMsgRec);
+            close(fd);
+        }
     }
+
+    // the workers see the input once the process 0 has loaded it
+    MPI_Win_fence(0, *win);
+    return sharedFiles;
 }
 
 /**
- * \brief Worker lifecycle:
- * - Ask for work
- * - If there is work, receive chunk from the dispatcher
- * - Process chunk
- * - Send partial results back to the dispatcher
- * 
- * \param rank worker rank
+ * \brief Reads a chunk of a file and merges its summary into the summary of the bytes before it.
+ *
+ * \param fd file descriptor
+ * \param chunk buffer of the chunk (chunkSize + 1 bytes)
+ * \param chunkSize number of bytes of the chunk
+ * \param offset offset of the chunk in the file
+ * \param summary summary of the bytes before the chunk
+ */
+static void processFileChunk(int fd, char *chunk, int chunkSize, int64_t offset, chunk_summary *summary) {
+    chunk_summary chunkSummary;
+
+    if (pread(fd, chunk, chunkSize, offset) != chunkSize) {
+        perror("Error reading file");
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+
+    findChunkEnds(chunk, chunkSize, &chunkSummary);
+    countWordsSimd(chunk + chunkSummary.headLength, chunkSize - chunkSummary.headLength - chunkSummary.tailLength, &chunkSummary.nWords, &chunkSummary.nWordsWMultCons);
+    mergeChunkSummaries(summary, &chunkSummary);
+}
+
+/**
+ * \brief Adds the counts of the summary of consecutive bytes of a file to the counts of the file, packs its partial words and frees it.
+ *
+ * \param summary summary of the bytes
+ * \param fileId index of the file
+ * \param offset offset of the first byte (in the input or in the file)
+ * \param counts words and words with equal consonants of each file
+ * \param packed (Pointer) packed partial words (share_summary followed by head and tail), reallocated to fit the new ones
+ * \param packedSize (Pointer) number of bytes of the packed partial words
+ */
+static void packShareSummary(chunk_summary *summary, int fileId, int64_t offset, int64_t *counts, char **packed, int *packedSize) {
+    share_summary header = {
+        .fileId = fileId,
+        .offset = offset,
+        .hasDelimiter = summary->hasDelimiter,
+        .headLength = summary->headLength,
+        .tailLength = summary->tailLength
+    };
+
+    counts[2 * fileId] += summary->nWords;
+    counts[2 * fileId + 1] += summary->nWordsWMultCons;
+
+    *packed = (char *)realloc(*packed, *packedSize + sizeof(share_summary) + header.headLength + header.tailLength);
+    memcpy(*packed + *packedSize, &header, sizeof(share_summary));
+    memcpy(*packed + *packedSize + sizeof(share_summary), summary->head, header.headLength);
+    memcpy(*packed + *packedSize + sizeof(share_summary) + header.headLength, summary->tail, header.tailLength);
+    *packedSize += sizeof(share_summary) + header.headLength + header.tailLength;
+
+    free(summary->head);
+    free(summary->tail);
+    memset(summary, 0, sizeof(chunk_summary));
+}
+
+/**
+ * \brief Compares two packed share summaries by their file and offset (for qsort).
+ */
+static int compareShareOffsets(const void *a, const void *b) {
+    share_summary headerA, headerB;
+
+    memcpy(&headerA, *(char * const *)a, sizeof(share_summary));
+    memcpy(&headerB, *(char * const *)b, sizeof(share_summary));
+    if (headerA.fileId != headerB.fileId) {
+        return headerA.fileId - headerB.fileId;
+    }
+    return (headerA.offset > headerB.offset) - (headerA.offset < headerB.offset);
+}
+
+/**
+ * \brief Combines the results of the shares of all processes in the process 0:
+ * - The counts of each file are combined with a reduction
+ * - The partial words of the shares are gathered and merged in the order of the input, counting the words split between shares
+ *
+ * \param finalFileData array with final results of each file (only used in the process 0)
+ * \param nFiles number of files
+ * \param counts words and words with equal consonants of each file, in this process
+ * \param packed packed partial words of the shares of this process (freed)
+ * \param packedSize number of bytes of the packed partial words
+ * \param rank process rank
+ * \param nProcesses number of processes
+ */
+static void combineShares(final_file_results *finalFileData, int nFiles, int64_t *counts, char *packed, int packedSize, int rank, int nProcesses) {
+    int64_t totalCounts[2 * nFiles];
+    int packedSizes[nProcesses], displacements[nProcesses];
+    int allPackedSize = 0, nShares = 0;
+    char *allPacked = NULL;
+    char **shares;
+    share_summary header;
+    chunk_summary summary;
+
+    MPI_Reduce(counts, totalCounts, 2 * nFiles, MPI_INT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    // the words split between shares are counted in the process 0
+    MPI_Gather(&packedSize, 1, MPI_INT, packedSizes, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (rank == 0) {
+        for (int i = 0; i < nProcesses; i++) {
+            displacements[i] = allPackedSize;
+            allPackedSize += packedSizes[i];
+        }
+        allPacked = (char *)malloc(allPackedSize > 0 ? allPackedSize : 1);
+    }
+    MPI_Gatherv(packed, packedSize, MPI_BYTE, allPacked, packedSizes, displacements, MPI_BYTE, 0, MPI_COMM_WORLD);
+    free(packed);
+
+    if (rank != 0) {
+        return;
+    }
+
+    // shares are merged in the order of the input
+    shares = (char **)malloc((allPackedSize / sizeof(share_summary) + 1) * sizeof(char *));
+    for (char *pos = allPacked; pos < allPacked + allPackedSize; nShares++) {
+        shares[nShares] = pos;
+        memcpy(&header, pos, sizeof(share_summary));
+        pos += sizeof(share_summary) + header.headLength + header.tailLength;
+    }
+    qsort(shares, nShares, sizeof(char *), compareShareOffsets);
+
+    for (int i = 0; i < nShares; i++) {
+        memcpy(&header, shares[i], sizeof(share_summary));
+        summary.nWords = 0; // already in the reduction
+        summary.nWordsWMultCons = 0;
+        summary.hasDelimiter = header.hasDelimiter;
+        summary.headLength = header.headLength;
+        summary.tailLength = header.tailLength;
+        summary.head = shares[i] + sizeof(share_summary);
+        summary.tail = summary.head + header.headLength;
+        mergeChunkSummaries(&finalFileData[header.fileId].summary, &summary);
+    }
+    free(shares);
+    free(allPacked);
+
+    for (int i = 0; i < nFiles; i++) {
+        finalFileData[i].nWords = totalCounts[2 * i];
+        finalFileData[i].nWordsWMultCons = totalCounts[2 * i + 1];
+        finishChunkSummary(&finalFileData[i].summary, &finalFileData[i].nWords, &finalFileData[i].nWordsWMultCons);
+    }
+}
+
+/**
+ * \brief Static partition lifecycle (every process, no dispatcher):
+ * - Compute the share of the input of this process from the file sizes (contiguous bytes across the files)
+ * - Process the share in chunks, merging their summaries for each file
+ * - Combine the results of all shares in the process 0
+ *
+ * \param finalFileData array with final results of each file (only used in the process 0)
+ * \param fileNames array with the names of the files
+ * \param nFiles number of files
+ * \param options options of the distribution of chunks (only the chunk size is used)
+ * \param rank process rank
+ * \param nProcesses number of processes
  */
-void workerRoutine(int rank) {
-    int chunkSize;
-    char *chunk;
+void processStaticShare(final_file_results *finalFileData, char **fileNames, int nFiles, const dispatch_options *options, int rank, int nProcesses) {
+    int64_t fileSizes[nFiles];
+    int64_t totalSize, fileStart = 0;
+    int64_t shareBegin, shareEnd; // bytes of the input (files one after the other) processed by this process
+    chunk_summary summary;
+    int64_t counts[2 * nFiles]; // words and words with equal consonants of each file
+    char *chunk = (char *)allocateChunkBuffer((options->chunkSize + 1) * sizeof(char));
+    char *packed = NULL; // partial words of the share of each file
+    int packedSize = 0;
 
-    partial_results partialResults;
-    int ptr;
-    char *currentChar = (char *) malloc(MAX_CHAR_LENGTH * sizeof(char));
+    totalSize = broadcastFileSizes(fileNames, nFiles, fileSizes, rank);
 
-    int consOcc[26];
-    bool detMultCons, inWord;
+    // balanced split: the first totalSize % nProcesses shares have one more byte
+    shareBegin = totalSize / nProcesses * rank + (rank < totalSize % nProcesses ? rank : totalSize % nProcesses);
+    shareEnd = shareBegin + totalSize / nProcesses + (rank < totalSize % nProcesses ? 1 : 0);
 
+    memset(counts, 0, sizeof(counts));
+    for (int i = 0; i < nFiles; fileStart += fileSizes[i], i++) {
+        int64_t begin = shareBegin > fileStart ? shareBegin : fileStart;
+        int64_t end = shareEnd < fileStart + fileSizes[i] ? shareEnd : fileStart + fileSizes[i];
+        if (begin >= end) {
+            continue;
+        }
+
+        int fd = open(fileNames[i], O_RDONLY);
+        if (fd < 0) {
+            perror("Error opening file");
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+        memset(&summary, 0, sizeof(chunk_summary));
+        for (int64_t offset = begin; offset < end; offset += options->chunkSize) {
+            int chunkSize = end - offset < options->chunkSize ? end - offset : options->chunkSize;
+            processFileChunk(fd, chunk, chunkSize, offset - fileStart, &summary);
+        }
+        close(fd);
+        packShareSummary(&summary, i, begin, counts, &packed, &packedSize);
+    }
+    free(chunk);
+
+    combineShares(finalFileData, nFiles, counts, packed, packedSize, rank, nProcesses);
+}
+
+/**
+ * \brief Work stealing lifecycle (every process, no dispatcher):
+ * - Start with a contiguous share of the chunks of the input, exposed in a window as one word (next, end)
+ * - Take chunks from the start of the own share with atomic compare-and-swap
+ * - When the own share is empty, steal the second half of the share of a random process, until all chunks are processed
+ * - Combine the results of all shares in the process 0
+ *
+ * Consecutive chunks of a file processed by the same process are merged into one share summary.
+ *
+ * \param finalFileData array with final results of each file (only used in the process 0)
+ * \param fileNames array with the names of the files
+ * \param nFiles number of files
+ * \param options options of the distribution of chunks (only the chunk size is used)
+ * \param rank process rank
+ * \param nProcesses number of processes
+ */
+void processStealingShare(final_file_results *finalFileData, char **fileNames, int nFiles, const dispatch_options *options, int rank, int nProcesses) {
+    int chunkSize = options->chunkSize;
+    int64_t fileSizes[nFiles], fileStarts[nFiles];
+    int64_t firstChunk[nFiles + 1]; // index of the first chunk of each file (chunks do not span files)
+    int64_t totalChunks, shareBegin, shareEnd;
+    int fileDescriptors[nFiles]; // files are opened when their first chunk is processed
+    uint64_t *window; // own share of chunks, and number of processed chunks (only in the process 0)
+    MPI_Win win;
+    uint64_t share, newShare, result;
+    uint64_t nProcessed = 0; // chunks processed and not added to the counter of the process 0
+    unsigned int seed = rank + 1;
+    int runFile = -1; // file of the consecutive chunks being merged
+    int64_t runFirst = 0, runNext = 0; // first and next chunk of the consecutive chunks being merged
+    chunk_summary summary;
+    int64_t counts[2 * nFiles]; // words and words with equal consonants of each file
+    char *chunk = (char *)allocateChunkBuffer((chunkSize + 1) * sizeof(char));
+    char *packed = NULL; // partial words of each run of consecutive chunks
+    int packedSize = 0;
+
+    broadcastFileSizes(fileNames, nFiles, fileSizes, rank);
+    firstChunk[0] = 0;
+    for (int i = 0; i < nFiles; i++) {
+        fileStarts[i] = i == 0 ? 0 : fileStarts[i - 1] + fileSizes[i - 1];
+        firstChunk[i + 1] = firstChunk[i] + (fileSizes[i] + chunkSize - 1) / chunkSize;
+        fileDescriptors[i] = -1;
+    }
+    totalChunks = firstChunk[nFiles];
+    if (totalChunks > MAX_STEALING_CHUNKS) {
+        if (rank == 0) {
+            fprintf(stderr, "Too many chunks for work stealing, use a larger chunk size\n");
+        }
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+
+    // balanced split of the chunks
+    shareBegin = totalChunks / nProcesses * rank + (rank < totalChunks % nProcesses ? rank : totalChunks % nProcesses);
+    shareEnd = shareBegin + totalChunks / nProcesses + (rank < totalChunks % nProcesses ? 1 : 0);
+
+    MPI_Win_allocate(2 * sizeof(uint64_t), sizeof(uint64_t), MPI_INFO_NULL, MPI_COMM_WORLD, &window, &win);
+    window[0] = SHARE(shareBegin, shareEnd);
+    window[1] = 0;
+    MPI_Win_lock_all(0, win);
+    MPI_Win_sync(win);
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    memset(counts, 0, sizeof(counts));
+    memset(&summary, 0, sizeof(chunk_summary));
     while (true) {
-        // ask for work
-        MPI_Send(&rank, 1, MPI_INT, 0, 0, MPI_COMM_WORLD);
+        int64_t chunkId = -1;
 
-        // receive chunk size (if 0, finish)
-        MPI_Recv(&chunkSize, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        // take the next chunk of the own share (other processes may be stealing from it)
+        MPI_Fetch_and_op(NULL, &share, MPI_UINT64_T, rank, 0, MPI_NO_OP, win);
+        MPI_Win_flush(rank, win);
+        while (SHARE_NEXT(share) < SHARE_END(share)) {
+            newShare = SHARE(SHARE_NEXT(share) + 1, SHARE_END(share));
+            MPI_Compare_and_swap(&newShare, &share, &result, MPI_UINT64_T, rank, 0, win);
+            MPI_Win_flush(rank, win);
+            if (result == share) {
+                chunkId = SHARE_NEXT(share);
+                break;
+            }
+            share = result;
+        }
 
-        if (chunkSize == 0) {
+        if (chunkId >= 0) {
+            // file of the chunk (the last file whose first chunk is not after it)
+            int low = 0, high = nFiles - 1;
+            while (low < high) {
+                int mid = (low + high + 1) / 2;
+                if (firstChunk[mid] <= chunkId) {
+                    low = mid;
+                } else {
+                    high = mid - 1;
+                }
+            }
+
+            // a chunk that does not follow the previous one starts a new run
+            if (low != runFile || chunkId != runNext) {
+                if (runFile >= 0) {
+                    packShareSummary(&summary, runFile, fileStarts[runFile] + (runFirst - firstChunk[runFile]) * chunkSize, counts, &packed, &packedSize);
+                }
+                runFile = low;
+                runFirst = chunkId;
+            }
+            runNext = chunkId + 1;
+
+            if (fileDescriptors[low] < 0) {
+                if ((fileDescriptors[low] = open(fileNames[low], O_RDONLY)) < 0) {
+                    perror("Error opening file");
+                    MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+                }
+            }
+            int64_t offset = (chunkId - firstChunk[low]) * chunkSize;
+            processFileChunk(fileDescriptors[low], chunk, fileSizes[low] - offset < chunkSize ? fileSizes[low] - offset : chunkSize, offset, &summary);
+            nProcessed++;
+            continue;
+        }
+
+        // the own share is empty: add the processed chunks to the counter, and finish if all chunks are processed
+        MPI_Fetch_and_op(&nProcessed, &result, MPI_UINT64_T, 0, 1, MPI_SUM, win);
+        MPI_Win_flush(0, win);
+        if (result + nProcessed == (uint64_t)totalChunks) {
             break;
         }
+        nProcessed = 0;
+
+        // steal the second half of the share of a random process
+        int victim = rand_r(&seed) % (nProcesses - 1);
+        victim += victim >= rank ? 1 : 0;
+        MPI_Fetch_and_op(NULL, &share, MPI_UINT64_T, victim, 0, MPI_NO_OP, win);
+        MPI_Win_flush(victim, win);
+        if (SHARE_NEXT(share) >= SHARE_END(share)) {
+            continue;
+        }
+        uint64_t half = SHARE_NEXT(share) + (SHARE_END(share) - SHARE_NEXT(share)) / 2;
+        newShare = SHARE(SHARE_NEXT(share), half);
+        MPI_Compare_and_swap(&newShare, &share, &result, MPI_UINT64_T, victim, 0, win);
+        MPI_Win_flush(victim, win);
+        if (result == share) {
+            newShare = SHARE(half, SHARE_END(share));
+            MPI_Fetch_and_op(&newShare, &result, MPI_UINT64_T, rank, 0, MPI_REPLACE, win);
+            MPI_Win_flush(rank, win);
+        }
+    }
 
-        chunk = (char *) malloc((chunkSize + 1) * sizeof(char));
-        MPI_Recv(chunk, chunkSize, MPI_CHAR, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    if (runFile >= 0) {
+        packShareSummary(&summary, runFile, fileStarts[runFile] + (runFirst - firstChunk[runFile]) * chunkSize, counts, &packed, &packedSize);
+    }
+    for (int i = 0; i < nFiles; i++) {
+        if (fileDescriptors[i] >= 0) {
+            close(fileDescriptors[i]);
+        }
+    }
+    free(chunk);
+
+    // other processes may still be reading the window until they see all chunks processed
+    MPI_Win_unlock_all(win);
+    combineShares(finalFileData, nFiles, counts, packed, packedSize, rank, nProcesses);
+    MPI_Win_free(&win);
+}
+
+/**
+ * \brief RMA chunk queue lifecycle (every process, no dispatcher):
+ * - The process 0 exposes a window with a counter of taken chunks followed by the descriptors (file, offset, length) of all chunks
+ * - Take the next chunk with an atomic fetch-and-add on the counter and get its descriptor, without the process 0 taking part
+ * - Read and process the chunk, until the counter passes the last chunk
+ * - Combine the results of all processes in the process 0
+ *
+ * Consecutive chunks of a file taken by the same process are merged into one share summary.
+ *
+ * \param finalFileData array with final results of each file (only used in the process 0)
+ * \param fileNames array with the names of the files
+ * \param nFiles number of files
+ * \param options options of the distribution of chunks (only the chunk size is used)
+ * \param rank process rank
+ * \param nProcesses number of processes
+ */
+void processQueuedChunks(final_file_results *finalFileData, char **fileNames, int nFiles, const dispatch_options *options, int rank, int nProcesses) {
+    int chunkSize = options->chunkSize;
+    int64_t fileSizes[nFiles];
+    int64_t totalChunks = 0;
+    char *window; // counter of taken chunks followed by the chunk descriptors (only in the process 0)
+    MPI_Win win;
+    MPI_Aint windowSize = 0;
+    uint64_t one = 1, chunkId;
+    chunk_range range;
+    int fileDescriptors[nFiles]; // files are opened when their first chunk is processed
+    int runFile = -1; // file of the consecutive chunks being merged
+    int64_t runOffset = 0, runNext = 0; // offset of the consecutive chunks being merged, and offset of the next chunk
+    chunk_summary summary;
+    int64_t counts[2 * nFiles]; // words and words with equal consonants of each file
+    char *chunk = (char *)allocateChunkBuffer((chunkSize + 1) * sizeof(char));
+    char *packed = NULL; // partial words of each run of consecutive chunks
+    int packedSize = 0;
 
-        partialResults.nWords = 0;
-        partialResults.nWordsWMultCons = 0;
-        inWord = false;
+    // all processes need the number of chunks, but the descriptors are only built in the process 0 (chunks do not span files)
+    broadcastFileSizes(fileNames, nFiles, fileSizes, rank);
+    for (int i = 0; i < nFiles; i++) {
+        totalChunks += (fileSizes[i] + chunkSize - 1) / chunkSize;
+        fileDescriptors[i] = -1;
+    }
+    if (rank == 0) {
+        windowSize = sizeof(uint64_t) + totalChunks * sizeof(chunk_range);
+    }
 
-        ptr = 0;
-        detMultCons = false;
-        memset(consOcc, 0, 26 * sizeof(int));
+    MPI_Win_allocate(windowSize, 1, MPI_INFO_NULL, MPI_COMM_WORLD, &window, &win);
+    if (rank == 0) {
+        chunk_range *descriptors = (chunk_range *)(window + sizeof(uint64_t));
+        int64_t chunkId = 0;
+        *(uint64_t *)window = 0;
+        for (int i = 0; i < nFiles; i++) {
+            for (int64_t offset = 0; offset < fileSizes[i]; offset += chunkSize, chunkId++) {
+                descriptors[chunkId].fileId = i;
+                descriptors[chunkId].offset = offset;
+                descriptors[chunkId].length = fileSizes[i] - offset < chunkSize ? fileSizes[i] - offset : chunkSize;
+                descriptors[chunkId].finished = offset + chunkSize >= fileSizes[i];
+            }
+        }
+    }
+    MPI_Win_lock_all(0, win);
+    MPI_Win_sync(win);
+    MPI_Barrier(MPI_COMM_WORLD);
 
-        chunk[chunkSize] = '\0';
+    memset(counts, 0, sizeof(counts));
+    memset(&summary, 0, sizeof(chunk_summary));
+    while (true) {
+        MPI_Fetch_and_op(&one, &chunkId, MPI_UINT64_T, 0, 0, MPI_SUM, win);
+        MPI_Win_flush(0, win);
+        if (chunkId >= (uint64_t)totalChunks) {
+            break;
+        }
+        MPI_Get(&range, 1, chunkRangeType, 0, sizeof(uint64_t) + chunkId * sizeof(chunk_range), 1, chunkRangeType, win);
+        MPI_Win_flush(0, win);
 
-        while (extractCharFromChunk(chunk, currentChar, &ptr) != -1) {
-            processChar(currentChar, &inWord, &partialResults.nWords, &partialResults.nWordsWMultCons, consOcc, &detMultCons);
+        // a chunk that does not follow the previous one starts a new run
+        if (range.fileId != runFile || range.offset != runNext) {
+            if (runFile >= 0) {
+                packShareSummary(&summary, runFile, runOffset, counts, &packed, &packedSize);
+            }
+            runFile = range.fileId;
+            runOffset = range.offset;
         }
+        runNext = range.offset + range.length;
 
-        // send back partial results
-        MPI_Send(&partialResults, sizeof(partialResults), MPI_BYTE, 0, 0, MPI_COMM_WORLD);
+        if (fileDescriptors[range.fileId] < 0) {
+            if ((fileDescriptors[range.fileId] = open(fileNames[range.fileId], O_RDONLY)) < 0) {
+                perror("Error opening file");
+                MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+            }
+        }
+        processFileChunk(fileDescriptors[range.fileId], chunk, range.length, range.offset, &summary);
+    }
+
+    if (runFile >= 0) {
+        packShareSummary(&summary, runFile, runOffset, counts, &packed, &packedSize);
     }
+    for (int i = 0; i < nFiles; i++) {
+        if (fileDescriptors[i] >= 0) {
+            close(fileDescriptors[i]);
+        }
+    }
+    free(chunk);
+
+    // other processes may still be taking chunks until they see the counter past the last one
+    MPI_Win_unlock_all(win);
+    combineShares(finalFileData, nFiles, counts, packed, packedSize, rank, nProcesses);
+    MPI_Win_free(&win);
 }
 
 /** \brief Prints the final results of each file.
@@ -226,44 +1339,167 @@ void workerRoutine(int rank) {
 void printResults(final_file_results *finalFileData, int _nFiles) {
     for (int i = 0; i < _nFiles; i++) {
         printf("File name: %s\n", finalFileData[i].fileName);
-        printf("Total number of words: %d\n", finalFileData[i].nWords);
-        printf("Total number of words with at least two instances of the same consonant: %d\n\n", finalFileData[i].nWordsWMultCons);
+        printf("Total number of words: %" PRId64 "\n", finalFileData[i].nWords);
+        printf("Total number of words with at least two instances of the same consonant: %" PRId64 "\n\n", finalFileData[i].nWordsWMultCons);
+    }
+}
+
+/**
+ * \brief Broadcasts the names of the files from the dispatcher to the workers.
+ *
+ * \param fileNames array with the names of the files (only used in the dispatcher)
+ * \param nFiles (Pointer) number of files (set in the workers)
+ * \param rank process rank
+ *
+ * \return array with the names of the files
+ */
+char **broadcastFileNames(char **fileNames, int *nFiles, int rank) {
+    int namesLength = 0;
+    char *names;
+
+    MPI_Bcast(nFiles, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    // names are sent in a single buffer, separated by null terminators
+    if (rank == 0) {
+        for (int i = 0; i < *nFiles; i++) {
+            namesLength += strlen(fileNames[i]) + 1;
+        }
+    }
+    MPI_Bcast(&namesLength, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    names = (char *)malloc(namesLength * sizeof(char));
+    if (rank == 0) {
+        for (int i = 0, pos = 0; i < *nFiles; i++) {
+            strcpy(names + pos, fileNames[i]);
+            pos += strlen(fileNames[i]) + 1;
+        }
+    }
+    MPI_Bcast(names, namesLength, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        free(names);
+        return fileNames;
     }
+
+    fileNames = (char **)malloc(*nFiles * sizeof(char *));
+    for (int i = 0, pos = 0; i < *nFiles; i++) {
+        fileNames[i] = names + pos;
+        pos += strlen(names + pos) + 1;
+    }
+    return fileNames;
+}
+
+/**
+ * \brief Selects an option of a group of mutually exclusive options, or aborts with a usage error if another one was selected.
+ *
+ * \param selected (Pointer) option of the group selected so far (NULL if none)
+ * \param option option given in the command line
+ * \param cmdName name of the program
+ */
+static void selectExclusiveOption(const char **selected, const char *option, const char *cmdName) {
+    if (*selected != NULL && strcmp(*selected, option) != 0) {
+        fprintf(stderr, "Options %s and %s cannot be combined\n", *selected, option);
+        fprintf(stderr, "Usage: %s [-d | -s] [-p prefetch_depth] [-c chunk_size] [-a] [--static | --steal | --rma] file1.txt file2.txt ...\n", cmdName);
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+    *selected = option;
 }
 
 int main(int argc, char *argv[]) {
     int rank, size;
+    char **fileNames = NULL;
+    int nFiles = 0;
+    MPI_Win sharedWin;
+    char **sharedFiles = NULL; // bytes of each file in the shared input
+    dispatch_options options = {
+        .sendRanges = false,
+        .sharedInput = false,
+        .prefetchDepth = 1,
+        .chunkSize = DEFAULT_CHUNK_SIZE,
+        .adaptive = false,
+        .staticPartition = false,
+        .workStealing = false,
+        .rmaQueue = false
+    };
 
     MPI_Init(&argc, &argv);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
 
-    if (size < 2) {
-        fprintf(stderr, "Error: This program requires at least 2 processes\n");
-        MPI_Finalize();
-        return EXIT_FAILURE;
-    }
-
-    // DISPATCHER
+    // process command line options
     if (rank == 0) {
-        char **fileNames;
         char *cmd_name = argv[0];
-        int nFiles;
+        const char *mode = NULL; // --static, --steal or --rma (NULL for the dispatcher)
+        const char *rangeOption = NULL; // -d or -s
+        const char *dispatcherOption = NULL; // last option that only applies to the dispatcher
 
         // process command line options
         int opt;
         do {
-            opt = getopt(argc, argv, "h");
+            opt = getopt_long(argc, argv, "dsp:c:ah", long_options, NULL);
             switch (opt) {
                 case 'h':
                     printf("Usage: mpiexec MPI_REQUIRED %s REQUIRED OPTIONAL\n"
                             "MPI_REQUIRED:\n"
-                            "-n number_of_processes    : number of processes (minimum is 2)\n"
+                            "-n number_of_processes    : number of processes (minimum is 2, or 1 with --static, --steal or --rma)\n"
                             "REQUIRED:\n"
                             "file1_path ... fileN_path : list of files to be processed\n"
                             "OPTIONAL:\n"
-                            "-h                        : shows how to use the program\n", cmd_name);
+                            "-d                        : sends chunk ranges (file, offset, length) and workers read the chunks\n"
+                            "-s                        : loads the input once into shared memory and workers process the chunk ranges in place (implies -d)\n"
+                            "-p prefetch_depth         : chunks queued in each worker while it processes one (default is 1)\n"
+                            "-c chunk_size             : bytes of each chunk (default is %d, at most %d)\n"
+                            "-a                        : adapts the chunk size to the time workers wait for chunks (starting at chunk_size)\n"
+                            "--static                  : every process processes its share of the input (no dispatcher, only -c can be added)\n"
+                            "--steal                   : as --static, but idle processes steal half of the remaining share of others\n"
+                            "--rma                     : every process takes chunks from a queue in a window of the process 0 (only -c can be added)\n"
+                            "-h                        : shows how to use the program\n", cmd_name, DEFAULT_CHUNK_SIZE, MAX_CHUNK_SIZE);
                     MPI_Abort(MPI_COMM_WORLD, EXIT_SUCCESS);
+                case 'd':
+                    selectExclusiveOption(&rangeOption, "-d", cmd_name);
+                    dispatcherOption = "-d";
+                    options.sendRanges = true;
+                    break;
+                case 's':
+                    selectExclusiveOption(&rangeOption, "-s", cmd_name);
+                    dispatcherOption = "-s";
+                    options.sendRanges = true;
+                    options.sharedInput = true;
+                    break;
+                case 'p':
+                    dispatcherOption = "-p";
+                    options.prefetchDepth = atoi(optarg);
+                    if (options.prefetchDepth < 1) {
+                        fprintf(stderr, "Invalid prefetch depth\n");
+                        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+                    }
+                    break;
+                case 'c': {
+                    // parsed as a long, so sizes past an int are rejected instead of wrapping
+                    long chunkSize = strtol(optarg, NULL, 10);
+                    if (chunkSize < 1 || chunkSize > MAX_CHUNK_SIZE) {
+                        fprintf(stderr, "Invalid chunk size (between 1 and %d)\n", MAX_CHUNK_SIZE);
+                        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+                    }
+                    options.chunkSize = chunkSize;
+                    break;
+                }
+                case 'a':
+                    dispatcherOption = "-a";
+                    options.adaptive = true;
+                    break;
+                case 'S':
+                    selectExclusiveOption(&mode, "--static", cmd_name);
+                    options.staticPartition = true;
+                    break;
+                case 'W':
+                    selectExclusiveOption(&mode, "--steal", cmd_name);
+                    options.workStealing = true;
+                    break;
+                case 'R':
+                    selectExclusiveOption(&mode, "--rma", cmd_name);
+                    options.rmaQueue = true;
+                    break;
                 case -1:
                     if (optind < argc) {
                         // process remaining arguments
@@ -275,16 +1511,77 @@ int main(int argc, char *argv[]) {
                         }
                     }
                     else {
-                        fprintf(stderr, "Usage: %s [-n n_workers] file1.txt file2.txt ...\n", cmd_name);
+                        fprintf(stderr, "Usage: %s [-d | -s] [-p prefetch_depth] [-c chunk_size] [-a] [--static | --steal | --rma] file1.txt file2.txt ...\n", cmd_name);
                         exit(EXIT_FAILURE);
                     }
                     break;
                 default:
-                    fprintf(stderr, "Usage: %s [-n n_workers] file1.txt file2.txt ...\n", cmd_name);
+                    fprintf(stderr, "Usage: %s [-d | -s] [-p prefetch_depth] [-c chunk_size] [-a] [--static | --steal | --rma] file1.txt file2.txt ...\n", cmd_name);
                     MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
             }
         } while (opt != -1);
 
+        // the modes without a dispatcher only use the chunk size
+        if (mode != NULL && dispatcherOption != NULL) {
+            selectExclusiveOption(&mode, dispatcherOption, cmd_name);
+        }
+
+        if (options.adaptive) {
+            if (options.chunkSize < MIN_ADAPTIVE_CHUNK_SIZE) {
+                options.chunkSize = MIN_ADAPTIVE_CHUNK_SIZE;
+            } else if (options.chunkSize > MAX_ADAPTIVE_CHUNK_SIZE) {
+                options.chunkSize = MAX_ADAPTIVE_CHUNK_SIZE;
+            }
+        }
+    }
+
+    // workers need the options, the number of files to count the words of each one, and the file names to read the chunk ranges
+    MPI_Bcast(&options, sizeof(dispatch_options), MPI_BYTE, 0, MPI_COMM_WORLD);
+    if (options.sendRanges || options.staticPartition || options.workStealing || options.rmaQueue) {
+        fileNames = broadcastFileNames(fileNames, &nFiles, rank);
+    } else {
+        MPI_Bcast(&nFiles, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    }
+
+    if (size < 2 && !options.staticPartition && !options.workStealing && !options.rmaQueue) {
+        if (rank == 0) {
+            fprintf(stderr, "Error: This program requires at least 2 processes (or --static, --steal or --rma)\n");
+        }
+        MPI_Finalize();
+        return EXIT_FAILURE;
+    }
+    chunkRangeType = createChunkRangeType();
+
+    // STATIC PARTITION, WORK STEALING OR RMA CHUNK QUEUE
+    if (options.staticPartition || options.workStealing || options.rmaQueue) {
+        final_file_results *finalFileData = NULL;
+        if (rank == 0) {
+            printf("%d processes with %s\n", size, options.rmaQueue ? "rma chunk queue" : options.workStealing ? "work stealing" : "static partition");
+            finalFileData = (final_file_results *)malloc(nFiles * sizeof(final_file_results));
+            for (int i = 0; i < nFiles; i++) {
+                finalFileData[i].fileName = fileNames[i];
+                memset(&finalFileData[i].summary, 0, sizeof(chunk_summary));
+            }
+        }
+        initializeCharMeaning(); // to start using wordUtils
+        initializeWordDfa();
+        initializeWordClassifier();
+
+        get_delta_time();
+        if (options.rmaQueue) {
+            processQueuedChunks(finalFileData, fileNames, nFiles, &options, rank, size);
+        } else if (options.workStealing) {
+            processStealingShare(finalFileData, fileNames, nFiles, &options, rank, size);
+        } else {
+            processStaticShare(finalFileData, fileNames, nFiles, &options, rank, size);
+        }
+        if (rank == 0) {
+            printf("Elapsed time: %f\n", get_delta_time());
+            printResults(finalFileData, nFiles);
+        }
+    }
+    // DISPATCHER
+    else if (rank == 0) {
         printf("1 dispatcher and %d workers\n", size - 1);
 
         final_file_results *finalFileData = (final_file_results *)malloc((nFiles + 1) * sizeof(final_file_results));
@@ -293,20 +1590,45 @@ int main(int argc, char *argv[]) {
             finalFileData[i].nWords = 0;
             finalFileData[i].nWordsWMultCons = 0;
             finalFileData[i].fp = NULL;
+            memset(&finalFileData[i].summary, 0, sizeof(chunk_summary));
+            finalFileData[i].chunkSummaries = NULL;
+            finalFileData[i].received = NULL;
+            finalFileData[i].nChunks = 0;
+            finalFileData[i].nMerged = 0;
+            finalFileData[i].capacity = 0;
         }
         initializeCharMeaning(); // to start using wordUtils
+        initializeWordDfa(); // to count the words split between chunks
 
         get_delta_time();
-        distributeChunks(finalFileData, size, nFiles);
+        if (options.sharedInput) {
+            sharedFiles = loadSharedInput(fileNames, nFiles, rank, &sharedWin);
+        }
+        distributeChunks(finalFileData, size, nFiles, &options);
         printf("Elapsed time: %f\n", get_delta_time());
         printResults(finalFileData, nFiles);
     }
     // WORKER
     else {
         initializeCharMeaning(); // to start using wordUtils
-        workerRoutine(rank);
+        initializeWordDfa();
+        initializeWordClassifier();
+        if (options.sharedInput) {
+            sharedFiles = loadSharedInput(fileNames, nFiles, rank, &sharedWin);
+        }
+        if (options.sendRanges) {
+            workerRangeRoutine(fileNames, nFiles, sharedFiles, &options);
+        } else {
+            workerRoutine(nFiles, &options);
+        }
+    }
+
+    if (sharedFiles != NULL) {
+        MPI_Win_free(&sharedWin);
+        free(sharedFiles);
     }
 
+    MPI_Type_free(&chunkRangeType);
     MPI_Finalize();
     return EXIT_SUCCESS;
 }
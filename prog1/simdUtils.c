@@ -0,0 +1,453 @@
+/**
+ *  \file simdUtils.c (implementation file)
+ *
+ *  \brief Assignment 2.1: mpi-based equal consonants.
+ *
+ *  This file contains the implementation of the vectorized word classifier.
+ *
+ *  Each block of 64 bytes is classified into masks, with one bit per byte: the first bytes of the characters that
+ *  start a word, the first bytes of the delimiters, and the first bytes of each consonant. The counts come from
+ *  carries that run through the masks:
+ *  - a word starts at a start character whose closest start or delimiter before it is a delimiter. Adding the
+ *    delimiters to the mask of the bytes that are not starts makes a carry run from each delimiter until the next
+ *    start, so the words are the starts that receive a carry, counted with popcount.
+ *  - there is at most one word between two delimiters, and it holds all the consonants found there. Adding the mask
+ *    of a consonant to the mask of the bytes that are not delimiters makes a carry run from each instance until the
+ *    next delimiter, so the repeated instances are the ones that receive a carry. The same is done with the repeated
+ *    consonants, so that only the first repetition of each word is counted.
+ *  The carries out of a block go into the next one.
+ *
+ *  The byte classes come from the functions of wordUtils, and are checked to follow the rules the kernels rely on:
+ *  the classes only depend on the first byte of a character, except for the E2 80 xx delimiters and the C3 xx
+ *  characters that fold to a consonant (ç), and the consonants are the same in upper and lower case.
+ *
+ *  \author João Fonseca
+ *  \author Rafael Gonçalves
+ */
+#include "simdUtils.h"
+
+#include "wordUtils.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#define DELIMITER_FIRST_BYTE 0xE2 // first byte of the multi-byte delimiters
+#define DELIMITER_SECOND_BYTE 0x80 // second byte of the multi-byte delimiters
+#define FOLDED_FIRST_BYTE 0xC3 // first byte of the multi-byte characters that fold to a consonant
+#define N_CONSONANTS ((int) sizeof(CONSONANTS) - 1)
+
+/** \brief Whether a byte is the first byte of a character that starts a word */
+static bool startByte[256];
+
+/** \brief Whether a byte is a single-byte delimiter */
+static bool delimiterByte[256];
+
+/** \brief Whether a byte is the last byte of a E2 80 xx delimiter */
+static bool delimiterLastByte[256];
+
+/** \brief Whether a byte is the last byte of a C3 xx character that folds to a consonant */
+static bool foldedLastByte[256];
+
+/** \brief Index in CONSONANTS of the consonant of the C3 xx characters */
+static int foldedConsonant;
+
+/** \brief Index in CONSONANTS + 1 of the consonant of each single-byte character, 0 if it is not a consonant */
+static uint8_t consonantByte[256];
+
+/** \brief Nibble tables of the byte sets (low nibble, then high nibble) */
+static uint8_t startNibbles[2][16], delimiterNibbles[2][16], delimiterLastNibbles[2][16], foldedLastNibbles[2][16];
+
+/** \brief Kernel that classifies a block (the bytes that follow it must be readable), selected from the cpu features */
+static void (*classifyBlock)(const unsigned char *block, uint64_t *starts, uint64_t *delimiters, uint64_t *consonants) = NULL;
+
+/**
+ * \brief Classifies a UTF-8 character with the functions of wordUtils.
+ *
+ * \param bytes Bytes of the (not normalized) UTF-8 character.
+ * \param length Number of bytes of the character.
+ * \param start Where it is stored whether the character starts a word.
+ * \param delimiter Where it is stored whether the character is a delimiter.
+ *
+ * \return Index in CONSONANTS + 1 of the consonant of the character, 0 if it is not a consonant.
+ */
+static int classifyChar(const unsigned char *bytes, int length, bool *start, bool *delimiter) {
+    char charUtf8[MAX_CHAR_LENGTH] = {0};
+    memcpy(charUtf8, bytes, length);
+    normalizeCharUtf8(charUtf8);
+    *start = isCharStartOfWordUtf8(charUtf8);
+    *delimiter = isCharNotAllowedInWordUtf8(charUtf8);
+
+    char *consonant = charUtf8[0] != '\0' ? strchr(CONSONANTS, charUtf8[0]) : NULL;
+    return consonant != NULL ? (int) (consonant - CONSONANTS) + 1 : 0;
+}
+
+/**
+ * \brief Builds the nibble tables of a set of bytes: a byte is in the set if the entries of its nibbles share a bit.
+ *
+ * Each bit stands for the low nibbles of the bytes in the set that share a high nibble, so at most 8 different ones fit.
+ *
+ * \param set Whether each byte is in the set.
+ * \param nibbles Where the tables are stored (low nibble, then high nibble).
+ *
+ * \return true if the set fits in the tables, false otherwise.
+ */
+static bool buildNibbleTables(const bool set[256], uint8_t nibbles[2][16]) {
+    uint16_t patterns[8];
+    int nPatterns = 0;
+
+    memset(nibbles, 0, 2 * 16 * sizeof(uint8_t));
+    for (int high = 0; high < 16; high++) {
+        uint16_t pattern = 0;
+        for (int low = 0; low < 16; low++) {
+            if (set[high << 4 | low]) {
+                pattern |= 1 << low;
+            }
+        }
+        if (pattern == 0) {
+            continue;
+        }
+
+        int bit = 0;
+        while (bit < nPatterns && patterns[bit] != pattern) {
+            bit++;
+        }
+        if (bit == nPatterns) {
+            if (nPatterns == 8) {
+                return false;
+            }
+            patterns[nPatterns++] = pattern;
+        }
+
+        nibbles[1][high] |= 1 << bit;
+        for (int low = 0; low < 16; low++) {
+            if (pattern & (1 << low)) {
+                nibbles[0][low] |= 1 << bit;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * \brief Classifies a block of 64 bytes one byte at a time.
+ *
+ * \param block Bytes to be classified, followed by SIMD_LOOKAHEAD readable bytes.
+ * \param starts Where the mask of the first bytes of the characters that start a word is stored.
+ * \param delimiters Where the mask of the first bytes of the delimiters is stored.
+ * \param consonants Where the mask of the first bytes of each consonant is stored.
+ */
+static void scalarClassifyBlock(const unsigned char *block, uint64_t *starts, uint64_t *delimiters, uint64_t *consonants) {
+    uint64_t s = 0, d = 0, c[N_CONSONANTS + 1] = {0}; // c[0] collects the bytes that are not consonants
+
+    for (int i = 0; i < SIMD_BLOCK_SIZE; i++) {
+        bool multiByteDelimiter = block[i] == DELIMITER_FIRST_BYTE && block[i + 1] == DELIMITER_SECOND_BYTE
+                                  && delimiterLastByte[block[i + 2]];
+        bool folded = block[i] == FOLDED_FIRST_BYTE && foldedLastByte[block[i + 1]];
+        s |= (uint64_t) startByte[block[i]] << i;
+        d |= (uint64_t) (delimiterByte[block[i]] || multiByteDelimiter) << i;
+        c[folded ? foldedConsonant + 1 : consonantByte[block[i]]] |= (uint64_t) 1 << i;
+    }
+
+    *starts = s;
+    *delimiters = d;
+    memcpy(consonants, c + 1, N_CONSONANTS * sizeof(uint64_t));
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/**
+ * \brief Finds the bytes of a vector that belong to a set, given by its nibble tables (avx2).
+ *
+ * \param v Vector of 32 bytes.
+ * \param nibbles Nibble tables of the set.
+ *
+ * \return Mask of the bytes in the set.
+ */
+__attribute__((target("avx2"))) static inline uint32_t avx2Match(__m256i v, const uint8_t nibbles[2][16]) {
+    __m256i lowTable = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) nibbles[0]));
+    __m256i highTable = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) nibbles[1]));
+    __m256i lowNibbles = _mm256_and_si256(v, _mm256_set1_epi8(0x0F));
+    __m256i highNibbles = _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F));
+    __m256i bits = _mm256_and_si256(_mm256_shuffle_epi8(lowTable, lowNibbles), _mm256_shuffle_epi8(highTable, highNibbles));
+    return ~(uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(bits, _mm256_setzero_si256()));
+}
+
+/**
+ * \brief Finds the bytes of a vector that are equal to a given byte (avx2).
+ *
+ * \param v Vector of 32 bytes.
+ * \param byte Byte to be found.
+ *
+ * \return Mask of the bytes found.
+ */
+__attribute__((target("avx2"))) static inline uint32_t avx2Equal(__m256i v, int byte) {
+    return (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8((char) byte)));
+}
+
+/**
+ * \brief Classifies a block of 64 bytes, 32 bytes at a time (avx2).
+ *
+ * \param block Bytes to be classified, followed by SIMD_LOOKAHEAD readable bytes.
+ * \param starts Where the mask of the first bytes of the characters that start a word is stored.
+ * \param delimiters Where the mask of the first bytes of the delimiters is stored.
+ * \param consonants Where the mask of the first bytes of each consonant is stored.
+ */
+__attribute__((target("avx2"))) static void avx2ClassifyBlock(const unsigned char *block, uint64_t *starts, uint64_t *delimiters, uint64_t *consonants) {
+    uint64_t s = 0, d = 0;
+    memset(consonants, 0, N_CONSONANTS * sizeof(uint64_t));
+
+    for (int half = 0; half < 2; half++) {
+        const unsigned char *p = block + 32 * half;
+        __m256i v0 = _mm256_loadu_si256((const __m256i *) p);
+        __m256i v1 = _mm256_loadu_si256((const __m256i *) (p + 1));
+        __m256i v2 = _mm256_loadu_si256((const __m256i *) (p + 2));
+        int shift = 32 * half;
+
+        // E2 80 xx delimiters: compare each byte and the two that follow it
+        uint32_t multiByte = avx2Equal(v0, DELIMITER_FIRST_BYTE) & avx2Equal(v1, DELIMITER_SECOND_BYTE)
+                             & avx2Match(v2, delimiterLastNibbles);
+        s |= (uint64_t) avx2Match(v0, startNibbles) << shift;
+        d |= (uint64_t) (avx2Match(v0, delimiterNibbles) | multiByte) << shift;
+
+        // upper case consonants differ from lower case ones in the 0x20 bit
+        __m256i lowerCase = _mm256_or_si256(v0, _mm256_set1_epi8(0x20));
+        for (int k = 0; k < N_CONSONANTS; k++) {
+            consonants[k] |= (uint64_t) avx2Equal(lowerCase, CONSONANTS[k]) << shift;
+        }
+        consonants[foldedConsonant] |= (uint64_t) (avx2Equal(v0, FOLDED_FIRST_BYTE) & avx2Match(v1, foldedLastNibbles)) << shift;
+    }
+
+    *starts = s;
+    *delimiters = d;
+}
+
+/**
+ * \brief Finds the bytes of a vector that belong to a set, given by its nibble tables (sse4.2).
+ *
+ * \param v Vector of 16 bytes.
+ * \param nibbles Nibble tables of the set.
+ *
+ * \return Mask of the bytes in the set.
+ */
+__attribute__((target("sse4.2"))) static inline uint32_t sseMatch(__m128i v, const uint8_t nibbles[2][16]) {
+    __m128i lowTable = _mm_loadu_si128((const __m128i *) nibbles[0]);
+    __m128i highTable = _mm_loadu_si128((const __m128i *) nibbles[1]);
+    __m128i lowNibbles = _mm_and_si128(v, _mm_set1_epi8(0x0F));
+    __m128i highNibbles = _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0F));
+    __m128i bits = _mm_and_si128(_mm_shuffle_epi8(lowTable, lowNibbles), _mm_shuffle_epi8(highTable, highNibbles));
+    return ~(uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(bits, _mm_setzero_si128())) & 0xFFFF;
+}
+
+/**
+ * \brief Finds the bytes of a vector that are equal to a given byte (sse4.2).
+ *
+ * \param v Vector of 16 bytes.
+ * \param byte Byte to be found.
+ *
+ * \return Mask of the bytes found.
+ */
+__attribute__((target("sse4.2"))) static inline uint32_t sseEqual(__m128i v, int byte) {
+    return (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8((char) byte)));
+}
+
+/**
+ * \brief Classifies a block of 64 bytes, 16 bytes at a time (sse4.2).
+ *
+ * \param block Bytes to be classified, followed by SIMD_LOOKAHEAD readable bytes.
+ * \param starts Where the mask of the first bytes of the characters that start a word is stored.
+ * \param delimiters Where the mask of the first bytes of the delimiters is stored.
+ * \param consonants Where the mask of the first bytes of each consonant is stored.
+ */
+__attribute__((target("sse4.2"))) static void sseClassifyBlock(const unsigned char *block, uint64_t *starts, uint64_t *delimiters, uint64_t *consonants) {
+    uint64_t s = 0, d = 0;
+    memset(consonants, 0, N_CONSONANTS * sizeof(uint64_t));
+
+    for (int quarter = 0; quarter < 4; quarter++) {
+        const unsigned char *p = block + 16 * quarter;
+        __m128i v0 = _mm_loadu_si128((const __m128i *) p);
+        __m128i v1 = _mm_loadu_si128((const __m128i *) (p + 1));
+        __m128i v2 = _mm_loadu_si128((const __m128i *) (p + 2));
+        int shift = 16 * quarter;
+
+        // E2 80 xx delimiters: compare each byte and the two that follow it
+        uint32_t multiByte = sseEqual(v0, DELIMITER_FIRST_BYTE) & sseEqual(v1, DELIMITER_SECOND_BYTE)
+                             & sseMatch(v2, delimiterLastNibbles);
+        s |= (uint64_t) sseMatch(v0, startNibbles) << shift;
+        d |= (uint64_t) (sseMatch(v0, delimiterNibbles) | multiByte) << shift;
+
+        // upper case consonants differ from lower case ones in the 0x20 bit
+        __m128i lowerCase = _mm_or_si128(v0, _mm_set1_epi8(0x20));
+        for (int k = 0; k < N_CONSONANTS; k++) {
+            consonants[k] |= (uint64_t) sseEqual(lowerCase, CONSONANTS[k]) << shift;
+        }
+        consonants[foldedConsonant] |= (uint64_t) (sseEqual(v0, FOLDED_FIRST_BYTE) & sseMatch(v1, foldedLastNibbles)) << shift;
+    }
+
+    *starts = s;
+    *delimiters = d;
+}
+
+#endif
+
+/**
+ * \brief Initializes the word classifier (the charMeaning array must be initialized first).
+ *
+ * The kernel (avx2, sse4.2 or scalar) is selected from the cpu features.
+ *
+ * \return true if the classifier can be used, false if the word rules do not fit it (then countWordsSimd falls back to processChunk).
+ */
+bool initializeWordClassifier() {
+    unsigned char bytes[MAX_CHAR_LENGTH];
+    bool start, delimiter;
+
+    // the last bytes of the E2 80 xx delimiters and of the C3 xx characters that fold to a consonant
+    foldedConsonant = -1;
+    for (int c = 0; c < 256; c++) {
+        bytes[0] = DELIMITER_FIRST_BYTE;
+        bytes[1] = DELIMITER_SECOND_BYTE;
+        bytes[2] = (unsigned char) c;
+        classifyChar(bytes, 3, &start, &delimiter);
+        delimiterLastByte[c] = delimiter && (c & 0xC0) == 0x80;
+
+        bytes[0] = FOLDED_FIRST_BYTE;
+        bytes[1] = (unsigned char) c;
+        int consonant = classifyChar(bytes, 2, &start, &delimiter);
+        foldedLastByte[c] = consonant != 0 && (c & 0xC0) == 0x80;
+        if (foldedLastByte[c]) {
+            if (foldedConsonant >= 0 && foldedConsonant != consonant - 1) {
+                return false;
+            }
+            foldedConsonant = consonant - 1;
+        }
+    }
+    if (foldedConsonant < 0) {
+        foldedConsonant = 0; // nothing folds, its mask stays empty
+    }
+
+    for (int c = 0; c < 256; c++) {
+        int length = lengthCharUtf8((char) c);
+        startByte[c] = false;
+        delimiterByte[c] = false;
+        consonantByte[c] = 0;
+        if (length == 0) {
+            continue; // a byte in the middle of a character
+        }
+
+        // whether a character starts a word must only depend on its first byte
+        bytes[0] = (unsigned char) c;
+        memset(bytes + 1, 0x80, MAX_CHAR_LENGTH - 1);
+        classifyChar(bytes, length, &start, &delimiter);
+        startByte[c] = start;
+
+        if (length == 1) {
+            int consonant = classifyChar(bytes, 1, &start, &delimiter);
+            char *lowerCase = strchr(CONSONANTS, c | 0x20);
+            int expectedConsonant = lowerCase != NULL ? (int) (lowerCase - CONSONANTS) + 1 : 0;
+            if ((start && delimiter) || consonant != expectedConsonant || (consonant != 0 && !start)) {
+                return false;
+            }
+            delimiterByte[c] = delimiter;
+            consonantByte[c] = (uint8_t) consonant;
+            continue;
+        }
+
+        // check every character of 2 and 3 bytes, and the first character of 4 bytes
+        int nCompletions = length == 2 ? 64 : length == 3 ? 64 * 64 : 1;
+        for (int i = 0; i < nCompletions; i++) {
+            bytes[1] = (unsigned char) (0x80 | (i & 0x3F));
+            if (length == 3) {
+                bytes[2] = (unsigned char) (0x80 | (i >> 6));
+            }
+            int consonant = classifyChar(bytes, length, &start, &delimiter);
+            bool expectedDelimiter = length == 3 && c == DELIMITER_FIRST_BYTE && bytes[1] == DELIMITER_SECOND_BYTE
+                                     && delimiterLastByte[bytes[2]];
+            int expectedConsonant = length == 2 && c == FOLDED_FIRST_BYTE && foldedLastByte[bytes[1]] ? foldedConsonant + 1 : 0;
+            if (start != startByte[c] || delimiter != expectedDelimiter || consonant != expectedConsonant
+                || (start && delimiter) || (consonant != 0 && !start)) {
+                return false;
+            }
+        }
+    }
+
+    classifyBlock = scalarClassifyBlock;
+#if defined(__x86_64__) || defined(__i386__)
+    if (buildNibbleTables(startByte, startNibbles) && buildNibbleTables(delimiterByte, delimiterNibbles)
+        && buildNibbleTables(delimiterLastByte, delimiterLastNibbles) && buildNibbleTables(foldedLastByte, foldedLastNibbles)) {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            classifyBlock = avx2ClassifyBlock;
+        }
+        else if (__builtin_cpu_supports("sse4.2")) {
+            classifyBlock = sseClassifyBlock;
+        }
+    }
+#endif
+    return true;
+}
+
+/**
+ * \brief Adds two masks and a carry, as one 65-bit number.
+ *
+ * \param a First mask.
+ * \param b Second mask.
+ * \param carry (Pointer) Carry into the lowest bit, replaced by the carry out of the highest bit.
+ *
+ * \return Sum of the masks.
+ */
+static inline uint64_t addWithCarry(uint64_t a, uint64_t b, uint64_t *carry) {
+    uint64_t sum = a + b;
+    uint64_t carryOut = sum < a;
+    sum += *carry;
+    *carry = carryOut | (sum < *carry);
+    return sum;
+}
+
+/**
+ * \brief Counts the words and the words with equal consonants of a chunk of text, with the word classifier.
+ *
+ * If the word rules do not fit the classifier, the word state machine is used instead.
+ *
+ * \param chunk Array of characters (chunk), which starts outside a word.
+ * \param chunkSize Number of bytes of the chunk.
+ * \param nWords (Pointer) Number of words found.
+ * \param nWordsWMultCons (Pointer) Number of words with equal consonants found.
+ */
+void countWordsSimd(const char *chunk, int chunkSize, int64_t *nWords, int64_t *nWordsWMultCons) {
+    if (classifyBlock == NULL) {
+        processChunk(chunk, chunkSize, nWords, nWordsWMultCons);
+        return;
+    }
+
+    const unsigned char *bytes = (const unsigned char *) chunk;
+    unsigned char lastBlock[SIMD_BLOCK_SIZE + SIMD_LOOKAHEAD];
+    uint64_t wordCarry = 1; // the chunk starts outside a word, as if right after a delimiter
+    uint64_t consonantCarry[N_CONSONANTS] = {0}, repeatCarry = 0;
+    int words = 0, wordsWMultCons = 0;
+
+    for (int i = 0; i < chunkSize; i += SIMD_BLOCK_SIZE) {
+        const unsigned char *block = bytes + i;
+        if (i + SIMD_BLOCK_SIZE + SIMD_LOOKAHEAD > chunkSize) {
+            // the bytes past the end of the chunk are zeros, which are neither starts, delimiters nor consonants
+            memset(lastBlock, 0, sizeof(lastBlock));
+            memcpy(lastBlock, block, chunkSize - i);
+            block = lastBlock;
+        }
+
+        uint64_t starts, delimiters, consonants[N_CONSONANTS];
+        classifyBlock(block, &starts, &delimiters, consonants);
+
+        // starts that receive a carry from a delimiter
+        words += __builtin_popcountll(addWithCarry(~starts, delimiters, &wordCarry) & starts);
+
+        // consonants that receive a carry from an earlier instance, then the first of them between two delimiters
+        uint64_t repeats = 0;
+        for (int k = 0; k < N_CONSONANTS; k++) {
+            repeats |= addWithCarry(~delimiters, consonants[k], &consonantCarry[k]) & consonants[k];
+        }
+        wordsWMultCons += __builtin_popcountll(repeats & ~addWithCarry(~delimiters, repeats, &repeatCarry));
+    }
+
+    *nWords += words;
+    *nWordsWMultCons += wordsWMultCons;
+}
@@ -0,0 +1,41 @@
+/**
+ *  \file simdUtils.h (interface file)
+ *
+ *  \brief Assignment 2.1: mpi-based equal consonants.
+ *
+ *  This file defines the vectorized word classifier, which counts the words (and the words with equal consonants) of a chunk of text 64 bytes at a time.
+ *
+ *  \author João Fonseca
+ *  \author Rafael Gonçalves
+ */
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef SIMD_UTILS_H
+#define SIMD_UTILS_H
+
+#define SIMD_BLOCK_SIZE 64 // bytes classified at a time, one bit of a mask per byte
+#define SIMD_LOOKAHEAD 2 // bytes read past each block, to find the multi-byte delimiters
+
+/**
+ * \brief Initializes the word classifier (the charMeaning array must be initialized first).
+ *
+ * The kernel (avx2, sse4.2 or scalar) is selected from the cpu features.
+ *
+ * \return true if the classifier can be used, false if the word rules do not fit it (then countWordsSimd falls back to processChunk).
+ */
+extern bool initializeWordClassifier();
+
+/**
+ * \brief Counts the words and the words with equal consonants of a chunk of text, with the word classifier.
+ *
+ * If the word rules do not fit the classifier, the word state machine is used instead.
+ *
+ * \param chunk Array of characters (chunk), which starts outside a word.
+ * \param chunkSize Number of bytes of the chunk.
+ * \param nWords (Pointer) Number of words found.
+ * \param nWordsWMultCons (Pointer) Number of words with equal consonants found.
+ */
+extern void countWordsSimd(const char *chunk, int chunkSize, int64_t *nWords, int64_t *nWordsWMultCons);
+
+#endif
@@ -13,6 +13,12 @@
 /** \brief Array that stores the meaning of each single-byte character (1. start of the word, 2. single-byte delimiter) */
 int charMeaning[256];
 
+/** \brief Transition table of the word state machine: next state in the low byte, action (DFA_ENTER, DFA_EXIT, consonant) in the high byte */
+static uint16_t dfaTable[DFA_MAX_STATES][256];
+
+/** \brief Number of states of the word state machine */
+static int nDfaStates;
+
 /**
  * \brief Returns the number of bytes of a UTF-8 character given its first byte.
  * 
@@ -101,192 +107,359 @@ int isCharNotAllowedInWordUtf8(const char *charUtf8) {
 }
 
 /**
- * \brief Extracts a UTF-8 character from a file. If the pointer is in the middle of a multi-byte character, it is moved to the beginning of the character.
+ * \brief Computes the transition of the word state machine for a whole UTF-8 character, the same way as the character-by-character processing.
  * 
- * \param textFile Pointer to the file from which a character will be extracted.
- * \param UTF8Char Where the extracted character will be stored.
- * \param charSize Where the number of bytes of the extracted character will be stored.
- * \param removePos How many bytes should the pointer be moved back to be at the beginning of the character (0 if single-byte character).
+ * \param bytes Bytes of the (not normalized) UTF-8 character.
+ * \param length Number of bytes of the character.
+ * \param inWord Whether the character is read inside a word.
  * 
- * \return The extracted character.
+ * \return The table entry: next state (DFA_OUT or DFA_IN) and action.
  */
-char extractCharFromFile(FILE *textFile, char *UTF8Char, uint8_t *charSize, uint8_t *removePos) {
-    char c;
-
-    // Determine number of bytes of the UTF-8 character
-    c = (char) fgetc(textFile); // Byte #1
-    if (c == EOF) {
-        memset(UTF8Char, 0, MAX_CHAR_LENGTH);
-        return EOF;
+static uint16_t charTransition(const unsigned char *bytes, int length, bool inWord) {
+    char charUtf8[MAX_CHAR_LENGTH] = {0};
+    memcpy(charUtf8, bytes, length);
+    normalizeCharUtf8(charUtf8);
+
+    int action = 0;
+    if (inWord && isCharNotAllowedInWordUtf8(charUtf8)) {
+        inWord = false;
+        action |= DFA_EXIT;
+    }
+    else if (!inWord && isCharStartOfWordUtf8(charUtf8)) {
+        inWord = true;
+        action |= DFA_ENTER;
+    }
+    if (charUtf8[0] != '\0' && strchr(CONSONANTS, charUtf8[0]) != NULL) {
+        action |= (charUtf8[0] - 'a' + 1) << DFA_CONSONANT_SHIFT;
     }
-    else {
-        *charSize = lengthCharUtf8(c);
-        if (*charSize == 0) {
-            // in the middle of a multi-byte UTF-8 character
-            *removePos += 1;
-            for (int i = 0; i < 2; i++) {
-                fseek(textFile, -2, SEEK_CUR);
-                c = (char) fgetc(textFile); // Byte #1
-                *charSize = lengthCharUtf8(c);
-                if (*charSize != 0) {
-                    break;
-                }
-                *removePos += 1;
-            }
-
-            // still invalid UTF-8 character
-            if (*charSize == 0) {
-                printf("Invalid UTF-8 character\n");
-                memset(UTF8Char, 0, MAX_CHAR_LENGTH);
-                exit(EXIT_FAILURE);
-            }
-        }
 
-        // Add the first byte to the UTF-8 character
-        UTF8Char[0] = c;
-
-        // Read the remaining bytes
-        for (int i = 1; i < *charSize; i++) {
-            c = (char) fgetc(textFile); // Byte #2, #3, #4
-            if (c == EOF) {
-                printf("Error reading char: EOF\n");
-                memset(UTF8Char, 0, MAX_CHAR_LENGTH);
-            }
-            else {
-                UTF8Char[i] = c;
-            }
-        }
-        // Add null terminator
-        UTF8Char[*charSize] = '\0';
-        normalizeCharUtf8(UTF8Char);
+    return (uint16_t) ((inWord ? DFA_IN : DFA_OUT) | action << 8);
+}
 
-        return 1;
+/**
+ * \brief Checks if all the completions of a partial UTF-8 character have the same transition.
+ * 
+ * \param bytes Bytes of the character, the first ones already set.
+ * \param read Number of bytes already set.
+ * \param length Number of bytes of the character.
+ * \param inWord Whether the character is read inside a word.
+ * \param entry Where the transition of the first completion is stored, and then compared with the others.
+ * \param first Whether no completion was evaluated yet.
+ * 
+ * \return true if all the completions have the same transition, false otherwise.
+ */
+static bool isTransitionUniform(unsigned char *bytes, int read, int length, bool inWord, uint16_t *entry, bool *first) {
+    if (read == length) {
+        uint16_t current = charTransition(bytes, length, inWord);
+        if (*first) {
+            *entry = current;
+            *first = false;
+        }
+        return current == *entry;
     }
+    // only continuation bytes complete a valid character
+    for (int c = 0x80; c <= 0xBF; c++) {
+        bytes[read] = (unsigned char) c;
+        if (!isTransitionUniform(bytes, read + 1, length, inWord, entry, first)) {
+            return false;
+        }
+    }
+    return true;
 }
 
 /**
- * \brief Extracts a UTF-8 character from a chunk of text.
+ * \brief Fills the transition of the word state machine for the next byte of a UTF-8 character.
+ * 
+ * If every character that starts with the bytes read so far has the same transition, it is done right away and the remaining bytes are skipped.
+ * Otherwise, a new state is added for these bytes (e.g. "ç" is a consonant, unlike the other characters that start with 0xC3).
  * 
- * \param chunk Array of characters (chunk).
- * \param UTF8Char Where the extracted character will be stored.
- * \param ptr Pointer to the position in the chunk.
+ * \param bytes Bytes of the character, the last one being the byte of the transition.
+ * \param read Number of bytes read, including the byte of the transition.
+ * \param length Number of bytes of the character.
+ * \param inWord Whether the character is read inside a word.
  * 
- * \return The extracted character.
+ * \return The table entry of the transition.
  */
-char extractCharFromChunk(char *chunk, char *UTF8Char, int *ptr) {
-    char c;
+static uint16_t prefixTransition(unsigned char *bytes, int read, int length, bool inWord) {
+    if (read == length) {
+        return charTransition(bytes, length, inWord);
+    }
 
-    // Determine number of bytes of the UTF-8 character
-    c = chunk[*ptr]; // Byte #1
+    uint16_t entry = 0;
+    bool first = true;
+    unsigned char completion[MAX_CHAR_LENGTH];
+    memcpy(completion, bytes, read);
+    if (isTransitionUniform(completion, read, length, inWord, &entry, &first)) {
+        // apply the action now and skip the remaining bytes of the character
+        int skipState = ((entry & 0xFF) == DFA_IN ? DFA_IN_SKIP : DFA_OUT_SKIP) + length - read - 1;
+        return (uint16_t) ((entry & 0xFF00) | skipState);
+    }
 
-    if (c == '\0') {
-        memset(UTF8Char, 0, MAX_CHAR_LENGTH);
-        return -1;
+    int state = nDfaStates++;
+    if (state >= DFA_MAX_STATES) {
+        fprintf(stderr, "Too many states in the word state machine\n");
+        exit(EXIT_FAILURE);
+    }
+    // the original processing takes the next bytes as part of the character, whatever they are
+    for (int c = 0; c < 256; c++) {
+        bytes[read] = (unsigned char) c;
+        dfaTable[state][c] = prefixTransition(bytes, read + 1, length, inWord);
     }
-    else {
-        int charLength = lengthCharUtf8(c);
+    return (uint16_t) state;
+}
 
-        if (charLength == 0) {
-            printf("Invalid UTF-8 character\n");
-            memset(UTF8Char, 0, MAX_CHAR_LENGTH);
+/**
+ * \brief Initializes the word state machine (the charMeaning array must be initialized first).
+ */
+void initializeWordDfa() {
+    nDfaStates = DFA_FIRST_PREFIX_STATE;
+
+    for (int k = 0; k < 3; k++) {
+        // skip the remaining k + 1 bytes of a character, without changing the word state
+        for (int c = 0; c < 256; c++) {
+            dfaTable[DFA_OUT_SKIP + k][c] = (uint16_t) (k == 0 ? DFA_OUT : DFA_OUT_SKIP + k - 1);
+            dfaTable[DFA_IN_SKIP + k][c] = (uint16_t) (k == 0 ? DFA_IN : DFA_IN_SKIP + k - 1);
         }
+    }
 
-        else {
-            // Add the first byte to the UTF-8 character
-            UTF8Char[0] = c;
-            (*ptr)++;
-
-            // Read the remaining bytes
-            for (int i = 1; i < charLength; i++) {
-                c = chunk[*ptr]; // Byte #2, #3, #4
-                if (c == EOF) {
-                    printf("Error reading char: EOF\n");
-                    memset(UTF8Char, 0, MAX_CHAR_LENGTH);
-                }
-                else {
-                    UTF8Char[i] = c;
-                }
-                (*ptr)++;
-            }
-
-            // Add null terminator
-            UTF8Char[charLength] = '\0';
-            normalizeCharUtf8(UTF8Char);
+    unsigned char bytes[MAX_CHAR_LENGTH];
+    for (int c = 0; c < 256; c++) {
+        bytes[0] = (unsigned char) c;
+        int length = lengthCharUtf8((char) c);
+        for (int inWord = 0; inWord < 2; inWord++) {
+            int state = inWord ? DFA_IN : DFA_OUT;
+            // a byte in the middle of a character is ignored
+            dfaTable[state][c] = length == 0 ? (uint16_t) state : prefixTransition(bytes, 1, length, inWord);
         }
-
-        return 1;
     }
 }
 
 /**
- * \brief Processes a character to determine if it is part of a word.
+ * \brief Counts the words and the words with equal consonants of a chunk of text, with the word state machine.
  * 
- * \param currentChar (Pointer) The character being processed.
- * \param inWord (Pointer) Whether the program is currently processing a word.
+ * \param chunk Array of characters (chunk), which starts outside a word.
+ * \param chunkSize Number of bytes of the chunk.
  * \param nWords (Pointer) Number of words found.
  * \param nWordsWMultCons (Pointer) Number of words with equal consonants found.
- * \param consOcc Array that stores the number of occurrences of each consonant in the words.
- * \param detMultCons (Pointer) Indicates if the current word has equal consonants.
  */
-void processChar(char *UTF8Char, bool *inWord, int *nWords, int *nWordsWMultCons, int consOcc[], bool *detMultCons) {
-    if (*inWord && isCharNotAllowedInWordUtf8(UTF8Char)) {
-        *inWord = false;
-        memset(consOcc, 0, 26 * sizeof(int));
+void processChunk(const char *chunk, int chunkSize, int64_t *nWords, int64_t *nWordsWMultCons) {
+    unsigned state = DFA_OUT;
+    uint32_t consSeen = 0; // bit i + 1 is set if the consonant 'a' + i was found in the current word
+    uint32_t detMultCons = 0;
+    int words = 0, wordsWMultCons = 0;
+
+    for (int i = 0; i < chunkSize; i++) {
+        unsigned entry = dfaTable[state][(unsigned char) chunk[i]];
+        state = entry & 0xFF;
+
+        // branchless, most bytes have an action
+        unsigned action = entry >> 8;
+        uint32_t enter = action & DFA_ENTER, leave = (action & DFA_EXIT) >> 1;
+        uint32_t consBit = (1u << (action >> DFA_CONSONANT_SHIFT)) & ~1u;
+
+        words += enter;
+        detMultCons &= enter - 1;
+        consSeen &= leave - 1;
+
+        uint32_t repeated = (consSeen & consBit) != 0;
+        wordsWMultCons += repeated & ~detMultCons;
+        detMultCons |= repeated;
+        consSeen |= consBit;
+    }
+
+    *nWords += words;
+    *nWordsWMultCons += wordsWMultCons;
+}
+
+/**
+ * \brief Appends bytes to a buffer allocated with malloc.
+ *
+ * \param buffer (Pointer) Buffer, reallocated to fit the new bytes.
+ * \param length (Pointer) Number of bytes of the buffer.
+ * \param bytes Bytes to be appended.
+ * \param nBytes Number of bytes to be appended.
+ */
+static void appendBytes(char **buffer, int *length, const char *bytes, int nBytes) {
+    if (nBytes == 0) {
+        return;
+    }
+    if (nBytes > INT_MAX - *length) {
+        fprintf(stderr, "Partial word too long (more than %d bytes without a delimiter)\n", INT_MAX);
+        exit(EXIT_FAILURE);
+    }
+    *buffer = (char *)realloc(*buffer, (*length + nBytes) * sizeof(char));
+    if (*buffer == NULL) {
+        fprintf(stderr, "Could not allocate memory for a partial word of %d bytes\n", *length + nBytes);
+        exit(EXIT_FAILURE);
+    }
+    memcpy(*buffer + *length, bytes, nBytes);
+    *length += nBytes;
+}
+
+/**
+ * \brief Checks if the character at the given position of a chunk is not allowed in a word.
+ *
+ * \param bytes Bytes of the character.
+ * \param charSize Number of bytes of the character.
+ *
+ * \return true if the character is not allowed in a word, false otherwise.
+ */
+static bool isDelimiterAt(const char *bytes, int charSize) {
+    char UTF8Char[MAX_CHAR_LENGTH] = {0};
+
+    memcpy(UTF8Char, bytes, charSize);
+    return isCharNotAllowedInWordUtf8(UTF8Char);
+}
+
+/**
+ * \brief Finds the first and last delimiters of a chunk cut at any byte, to summarize it.
+ *
+ * The counts of the summary are set to 0: the words between the head and the tail are counted by the caller.
+ *
+ * \param chunk Array of characters (chunk), which may start and end in the middle of a word or of a character.
+ * \param chunkSize Number of bytes of the chunk.
+ * \param summary Where the head and tail of the chunk will be stored (they point to the chunk).
+ */
+void findChunkEnds(const char *chunk, int chunkSize, chunk_summary *summary) {
+    int first = 0, last, charSize = 0;
+
+    summary->nWords = 0;
+    summary->nWordsWMultCons = 0;
+    summary->hasDelimiter = false;
+
+    // first delimiter, skipping the end of a character started in the previous chunk
+    while (first < chunkSize && lengthCharUtf8(chunk[first]) == 0) {
+        first++;
     }
-    else if (!(*inWord) && isCharStartOfWordUtf8(UTF8Char)) {
-        *inWord = true;
-        *detMultCons = false;
-        (*nWords)++;
+    for (; first < chunkSize; first += charSize) {
+        charSize = lengthCharUtf8(chunk[first]);
+        if (charSize == 0) {
+            charSize = 1; // invalid byte, not a delimiter
+            continue;
+        }
+        if (first + charSize > chunkSize) {
+            break; // the character ends in the next chunk
+        }
+        if (isDelimiterAt(chunk + first, charSize)) {
+            summary->hasDelimiter = true;
+            break;
+        }
     }
 
-    if (strchr(CONSONANTS, UTF8Char[0]) != NULL) {
-        consOcc[UTF8Char[0] - 'a']++;
+    summary->head = (char *)chunk;
+    if (!summary->hasDelimiter) {
+        summary->headLength = chunkSize;
+        summary->tail = (char *)chunk + chunkSize;
+        summary->tailLength = 0;
+        return;
+    }
+    summary->headLength = first;
 
-        if (!(*detMultCons) && consOcc[UTF8Char[0] - 'a'] > 1) {
-            (*nWordsWMultCons)++;
-            *detMultCons = true;
+    // last delimiter, going back one character at a time (the first delimiter stops the search)
+    for (last = chunkSize; ; ) {
+        int charStart = last - 1;
+        while (charStart > first && lengthCharUtf8(chunk[charStart]) == 0) {
+            charStart--;
+        }
+        charSize = lengthCharUtf8(chunk[charStart]);
+        if (charSize != 0 && charStart + charSize <= chunkSize && isDelimiterAt(chunk + charStart, charSize)) {
+            last = charStart + charSize;
+            break;
         }
+        last = charStart;
     }
+    summary->tail = (char *)chunk + last;
+    summary->tailLength = chunkSize - last;
 }
 
-/** \brief Retrieves a chunk of data from the current file.
+/**
+ * \brief Merges the summary of a chunk into the summary of the chunks before it, counting the words split between them.
  *
- *  \param fp file pointer
- *  \param chunkData pointer to the chunk data structure
+ * \param left Summary of the previous chunks (its head and tail are allocated with malloc, or NULL).
+ * \param right Summary of the next chunk (its head and tail are copied).
  */
-void retrieveData(FILE *fp, chunk_data *chunkData) {
-    // read chunk
-    chunkData->chunkSize = fread(chunkData->chunk, 1, MAX_CHUNK_SIZE, fp);
-    chunkData->finished = false;
-
-    // if chunk size is less than MAX_CHUNK_SIZE, then it is the last chunk
-    if (chunkData->chunkSize < MAX_CHUNK_SIZE) {
-        chunkData->finished = true;
-    }
-    else {
-        // read until a word is complete
-        char *UTF8Char = (char *) malloc(MAX_CHAR_LENGTH * sizeof(char));
-        uint8_t charSize;
-        uint8_t removePos = 0;
-
-        while (extractCharFromFile(fp, UTF8Char, &charSize, &removePos) != EOF) {
-            if (isCharNotAllowedInWordUtf8(UTF8Char)) {
-                chunkData->chunkSize -= removePos;
-                chunkData->chunk[chunkData->chunkSize] = '\0';
-                break;
-            }
-
-            // realloc chunk if necessary
-            if (chunkData->chunkSize + charSize > MAX_CHUNK_SIZE) {
-                chunkData->chunk = (char *)realloc(chunkData->chunk, (chunkData->chunkSize + charSize + 1) * sizeof(char));
-            }
-
-            // add char to chunk
-            for (int i = 0; i < charSize; i++) {
-                chunkData->chunk[chunkData->chunkSize] = UTF8Char[i];
-                chunkData->chunkSize++;
-            }
+void mergeChunkSummaries(chunk_summary *left, const chunk_summary *right) {
+    if (!right->hasDelimiter) {
+        // the right chunk continues the last partial word of the left one
+        if (left->hasDelimiter) {
+            appendBytes(&left->tail, &left->tailLength, right->head, right->headLength);
+        } else {
+            appendBytes(&left->head, &left->headLength, right->head, right->headLength);
         }
+        return;
+    }
+
+    if (left->hasDelimiter) {
+        // count the word split between the chunks (the tail starts and the head ends outside a word)
+        appendBytes(&left->tail, &left->tailLength, right->head, right->headLength);
+        processChunk(left->tail, left->tailLength, &left->nWords, &left->nWordsWMultCons);
+    } else {
+        appendBytes(&left->head, &left->headLength, right->head, right->headLength);
+        left->hasDelimiter = true;
+    }
+
+    left->nWords += right->nWords;
+    left->nWordsWMultCons += right->nWordsWMultCons;
+    left->tailLength = 0;
+    appendBytes(&left->tail, &left->tailLength, right->tail, right->tailLength);
+}
+
+/**
+ * \brief Adds the counts of a summary of a whole file, including the words at its start and end, and frees it.
+ *
+ * \param summary Summary of all the chunks of a file.
+ * \param nWords (Pointer) Number of words found.
+ * \param nWordsWMultCons (Pointer) Number of words with equal consonants found.
+ */
+void finishChunkSummary(chunk_summary *summary, int64_t *nWords, int64_t *nWordsWMultCons) {
+    *nWords += summary->nWords;
+    *nWordsWMultCons += summary->nWordsWMultCons;
+
+    // the file starts and ends outside a word
+    processChunk(summary->head, summary->headLength, nWords, nWordsWMultCons);
+    if (summary->hasDelimiter) {
+        processChunk(summary->tail, summary->tailLength, nWords, nWordsWMultCons);
+    }
+
+    free(summary->head);
+    free(summary->tail);
+    memset(summary, 0, sizeof(chunk_summary));
+}
+
+/** \brief Retrieves a chunk of data from the current file (chunkSize bytes, or the rest of the file).
+ *
+ *  \param fp file pointer
+ *  \param chunkData pointer to the chunk data structure (its buffer must fit chunkSize + 1 bytes)
+ *  \param chunkSize number of bytes of the chunk
+ */
+void retrieveData(FILE *fp, chunk_data *chunkData, int chunkSize) {
+    int next;
+
+    chunkData->chunkSize = fread(chunkData->chunk, 1, chunkSize, fp);
+
+    // it is the last chunk if there is nothing after it
+    next = fgetc(fp);
+    chunkData->finished = next == EOF;
+    if (!chunkData->finished) {
+        ungetc(next, fp);
     }
     chunkData->chunk[chunkData->chunkSize] = '\0';
+}
+
+/** \brief Retrieves the range of the next chunk of the current file (chunkSize bytes, or the rest of the file), without reading its content.
+ *
+ *  \param fp file pointer (at the start of the chunk)
+ *  \param chunkRange pointer to the chunk range structure
+ *  \param chunkSize number of bytes of the chunk
+ */
+void retrieveRange(FILE *fp, chunk_range *chunkRange, int chunkSize) {
+    off_t fileSize;
+
+    chunkRange->offset = ftello(fp);
+    fseeko(fp, 0, SEEK_END);
+    fileSize = ftello(fp);
+
+    chunkRange->length = fileSize - chunkRange->offset < chunkSize ? fileSize - chunkRange->offset : chunkSize;
+    chunkRange->finished = chunkRange->offset + chunkRange->length == fileSize;
+    fseeko(fp, chunkRange->offset + chunkRange->length, SEEK_SET);
 }
\ No newline at end of file
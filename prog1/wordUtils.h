@@ -12,7 +12,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <limits.h>
 #include <stdbool.h>
+#include <sys/types.h>
 
 #ifndef WORD_UTILS_H
 #define WORD_UTILS_H
@@ -22,7 +24,21 @@
 #define SINGLE_BYTE_DELIMITERS " \t\n\r-\"[]().,:;?!–"
 #define MAX_CHAR_LENGTH 5 // max number of bytes of a UTF-8 character + null terminator
 #define CONSONANTS "bcdfghjklmnpqrstvwxyz"
-#define MAX_CHUNK_SIZE 4096
+#define DEFAULT_CHUNK_SIZE 4096 // bytes of each chunk (all but the last of each file), unless set with -c
+#define MAX_CHUNK_SIZE (1 << 30) // largest chunk size (-c), so the chunk buffers and the messages with a chunk or its results (with their headers) fit in an int
+#define MIN_ADAPTIVE_CHUNK_SIZE 1024 // the adaptive chunk size (-a) stays in [MIN_ADAPTIVE_CHUNK_SIZE, MAX_ADAPTIVE_CHUNK_SIZE]
+#define MAX_ADAPTIVE_CHUNK_SIZE (4 << 20)
+
+// Word state machine: one state per byte, driven by a table built from the functions below
+#define DFA_MAX_STATES 32
+#define DFA_OUT 0 // outside a word, at the start of a character
+#define DFA_IN 1 // inside a word, at the start of a character
+#define DFA_OUT_SKIP 2 // outside a word, skipping the last 1, 2 or 3 bytes of a character
+#define DFA_IN_SKIP 5 // inside a word, skipping the last 1, 2 or 3 bytes of a character
+#define DFA_FIRST_PREFIX_STATE 8 // states for the first bytes of characters that need the next bytes to be classified
+#define DFA_ENTER 0x01 // action: a word starts
+#define DFA_EXIT 0x02 // action: a word ends
+#define DFA_CONSONANT_SHIFT 2 // action: consonant 'a' + i, stored as i + 1 from this bit
 
 /** \brief Structure that stores the content and size of a chunk of text, and whether it is the last one */
 typedef struct {
@@ -31,6 +47,30 @@ typedef struct {
     bool finished;
 } chunk_data;
 
+/** \brief Structure that describes a chunk by its position in a file */
+typedef struct {
+    int fileId;
+    int length; // at most MAX_CHUNK_SIZE
+    int64_t offset;
+    bool finished;
+} chunk_range;
+
+/**
+ * \brief Structure that summarizes a chunk cut at any byte: the counts of the words between its first and last delimiters,
+ * and the partial words before the first delimiter (head) and after the last one (tail).
+ *
+ * Summaries of consecutive chunks are merged with mergeChunkSummaries. A zeroed summary is an empty chunk.
+ */
+typedef struct {
+    int64_t nWords;
+    int64_t nWordsWMultCons;
+    bool hasDelimiter; // false if the chunk has no complete delimiter (all its bytes are in the head)
+    int headLength; // at most MAX_CHUNK_SIZE for a single chunk, the partial word can grow when merged
+    int tailLength; // same as headLength
+    char *head;
+    char *tail;
+} chunk_summary;
+
 /** \brief Array that stores the meaning of each single-byte character (1. start of the word, 2. single-byte delimiter) */
 extern int charMeaning[256];
 
@@ -72,45 +112,62 @@ extern int isCharStartOfWordUtf8(const char *charUtf8);
 extern int isCharNotAllowedInWordUtf8(const char *charUtf8);
 
 /**
- * \brief Extracts a UTF-8 character from a file. If the pointer is in the middle of a multi-byte character, it is moved to the beginning of the character.
- * 
- * \param textFile Pointer to the file from which a character will be extracted.
- * \param UTF8Char Where the extracted character will be stored.
- * \param charSize Where the number of bytes of the extracted character will be stored.
- * \param removePos How many bytes should the pointer be moved back to be at the beginning of the character (0 if single-byte character).
- * 
- * \return The extracted character.
+ * \brief Initializes the word state machine (the charMeaning array must be initialized first).
  */
-extern char extractCharFromFile(FILE *textFile, char *UTF8Char, uint8_t *charSize, uint8_t *removePos);
+extern void initializeWordDfa();
 
 /**
- * \brief Extracts a UTF-8 character from a chunk of text.
+ * \brief Counts the words and the words with equal consonants of a chunk of text, with the word state machine.
  * 
- * \param chunk Array of characters (chunk).
- * \param UTF8Char Where the extracted character will be stored.
- * \param ptr Pointer to the position in the chunk.
- * 
- * \return The extracted character.
+ * \param chunk Array of characters (chunk), which starts outside a word.
+ * \param chunkSize Number of bytes of the chunk.
+ * \param nWords (Pointer) Number of words found.
+ * \param nWordsWMultCons (Pointer) Number of words with equal consonants found.
  */
-extern char extractCharFromChunk(char *chunk, char *UTF8Char, int *ptr);
+extern void processChunk(const char *chunk, int chunkSize, int64_t *nWords, int64_t *nWordsWMultCons);
 
 /**
- * \brief Processes a character to determine if it is part of a word.
- * 
- * \param currentChar (Pointer) The character being processed.
- * \param inWord (Pointer) Whether the program is currently processing a word.
+ * \brief Finds the first and last delimiters of a chunk cut at any byte, to summarize it.
+ *
+ * The counts of the summary are set to 0: the words between the head and the tail are counted by the caller.
+ *
+ * \param chunk Array of characters (chunk), which may start and end in the middle of a word or of a character.
+ * \param chunkSize Number of bytes of the chunk.
+ * \param summary Where the head and tail of the chunk will be stored (they point to the chunk).
+ */
+extern void findChunkEnds(const char *chunk, int chunkSize, chunk_summary *summary);
+
+/**
+ * \brief Merges the summary of a chunk into the summary of the chunks before it, counting the words split between them.
+ *
+ * \param left Summary of the previous chunks (its head and tail are allocated with malloc, or NULL).
+ * \param right Summary of the next chunk (its head and tail are copied).
+ */
+extern void mergeChunkSummaries(chunk_summary *left, const chunk_summary *right);
+
+/**
+ * \brief Adds the counts of a summary of a whole file, including the words at its start and end, and frees it.
+ *
+ * \param summary Summary of all the chunks of a file.
  * \param nWords (Pointer) Number of words found.
  * \param nWordsWMultCons (Pointer) Number of words with equal consonants found.
- * \param consOcc Array that stores the number of occurrences of each consonant in the words.
- * \param detMultCons (Pointer) Indicates if the current word has equal consonants.
  */
-extern void processChar(char *currentChar, bool *inWord, int *nWords, int *nWordsWMultCons, int consOcc[], bool *detMultCons);
+extern void finishChunkSummary(chunk_summary *summary, int64_t *nWords, int64_t *nWordsWMultCons);
 
-/** \brief Retrieves a chunk of data from the current file.
+/** \brief Retrieves a chunk of data from the current file (chunkSize bytes, or the rest of the file).
  *
  *  \param fp file pointer
- *  \param chunkData pointer to the chunk data structure
+ *  \param chunkData pointer to the chunk data structure (its buffer must fit chunkSize + 1 bytes)
+ *  \param chunkSize number of bytes of the chunk
+ */
+extern void retrieveData(FILE *fp, chunk_data *chunkData, int chunkSize);
+
+/** \brief Retrieves the range of the next chunk of the current file (chunkSize bytes, or the rest of the file), without reading its content.
+ *
+ *  \param fp file pointer (at the start of the chunk)
+ *  \param chunkRange pointer to the chunk range structure
+ *  \param chunkSize number of bytes of the chunk
  */
-extern void retrieveData(FILE *fp, chunk_data *chunkData);
+extern void retrieveRange(FILE *fp, chunk_range *chunkRange, int chunkSize);
 
 #endif
\ No newline at end of file
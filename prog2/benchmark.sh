@@ -13,7 +13,7 @@ N_ITERATIONS=15
 mkdir -p $OUTPUT_FOLDER
 
 # Compile the source code
-mpicc -Wall -O3 -o bmprog2 mpiBitonic.c sortUtils.c
+mpicc -Wall -O3 -fopenmp -o bmprog2 mpiBitonic.c sortUtils.c simdUtils.c
 
 # Run the program for each configuration of processes and array sizes
 for size in $NUMBERS_SIZES; do
@@ -0,0 +1,35 @@
+# Usage: ./benchmark_kernel.sh
+# Description: Compiles the source code with the recursive and with the iterative, cache-blocked bitonic kernels, runs
+#              both with a single process (so only the local kernel is measured), and outputs the results in a
+#              "results/kernel" folder, for each array size (256K, 1M, 16M).
+# Example: ./benchmark_kernel.sh
+
+OUTPUT_FOLDER="results/kernel"
+NUMBERS_FOLDER="data"
+NUMBERS_SIZES="256K 1M 16M"
+N_ITERATIONS=15
+
+# Create the output folder
+mkdir -p $OUTPUT_FOLDER
+
+# Compile the source code with each kernel
+mpicc -Wall -O3 -fopenmp -DRECURSIVE_BITONIC -o bmrecursive mpiBitonic.c sortUtils.c simdUtils.c
+mpicc -Wall -O3 -fopenmp -o bmiterative mpiBitonic.c sortUtils.c simdUtils.c
+
+# Run each kernel for each array size
+for size in $NUMBERS_SIZES; do
+  for kernel in recursive iterative; do
+    echo "Running $kernel kernel $N_ITERATIONS times for $size numbers..."
+    # Create the output file
+    OUTPUT_FILE="$OUTPUT_FOLDER/$kernel-n$size.txt"
+    rm -f $OUTPUT_FILE
+    touch $OUTPUT_FILE
+    # Run the program and save the results
+    for i in $(seq 1 $N_ITERATIONS); do
+      mpiexec -n 1 ./bm$kernel -f $NUMBERS_FOLDER/datSeq$size.bin | grep -Po 'Time elapsed\s*:\s*\K[0-9.]+' >> $OUTPUT_FILE
+    done
+  done
+done
+
+# Clean-up
+rm -f bmrecursive bmiterative
@@ -18,4 +18,34 @@
 /** \brief Ascending sort direction */
 #define ASCENDING 1
 
+/** \brief Largest block handed off to the in-register sorting networks (8 or 16) */
+#define SIMD_BLOCK_SIZE 16
+
+/** \brief Number of elements (256 KiB) of the tiles whose bitonic stages are finished while they are in the cache */
+#define CACHE_TILE_SIZE 65536
+
+/** \brief Largest number of pieces in which blocks are exchanged (each piece has its own message tag) */
+#define MAX_PIECES 1024
+
+/** \brief Largest block of each process, padding included, so that its indices and their doubling fit in an int */
+#define MAX_BLOCK_SIZE (1 << 29)
+
+/** \brief Number of independent ranges merged together by merge_split, to overlap their dependency chains */
+#define MERGE_PATHS 8
+
+/** \brief Local sort of each block with the bitonic sort */
+#define LOCAL_SORT_BITONIC 0
+
+/** \brief Local sort of each block with the lsd radix sort */
+#define LOCAL_SORT_RADIX 1
+
+/** \brief Local sort of each block with the introsort */
+#define LOCAL_SORT_INTRO 2
+
+/** \brief Blocks smaller than this are insertion sorted by the introsort */
+#define INSERTION_SORT_SIZE 16
+
+/** \brief Sides of the introsort partitions larger than this are sorted as tasks, by any thread */
+#define INTRO_TASK_SIZE 16384
+
 #endif /* CONST_H */
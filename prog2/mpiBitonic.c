@@ -11,13 +11,19 @@
 
 #include <assert.h>
 #include <getopt.h>
+#include <limits.h>
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "const.h"
+#include "simdUtils.h"
 #include "sortUtils.h"
 
 /**
@@ -29,14 +35,26 @@ void printUsage(char *cmd_name) {
     fprintf(stderr,
             "Usage: mpiexec MPI_REQUIRED %s REQUIRED OPTIONAL\n"
             "MPI_REQUIRED\n"
-            "-n number_of_processes : number of processes (minimum is 1, must be power of 2)\n"
+            "-n number_of_processes : number of processes (minimum is 1)\n"
             "REQUIRED\n"
             "-f input_file_path     : input file with numbers\n"
             "OPTIONAL\n"
+            "-t number_of_threads   : threads of each process for the local sort and merges (default is 1)\n"
+            "-s number_of_pieces    : pieces in which blocks are exchanged and merged as they arrive (default is 1, at most 1024)\n"
+            "--local-sort=algorithm : local sort of each block: bitonic, radix or intro (default is bitonic)\n"
             "-h                     : shows how to use the program\n",
             cmd_name);
 }
 
+/** \brief Names of the local sort algorithms, indexed by LOCAL_SORT_* */
+static const char *local_sort_names[] = {"bitonic", "radix", "intro"};
+
+/** \brief Long options of the program */
+static const struct option long_options[] = {
+    {"local-sort", required_argument, NULL, 'l'},
+    {NULL, 0, NULL, 0},
+};
+
 /**
  *  \brief Gets the time elapsed since the last call to this function.
  *
@@ -55,22 +73,144 @@ static double get_delta_time(void) {
     return (double)(t1.tv_sec - t0.tv_sec) + 1.0e-9 * (double)(t1.tv_nsec - t0.tv_nsec);
 }
 
+/**
+ *  \brief Reads the block of the array assigned to this process, using collective mpi-io.
+ *
+ *  Every process reads its own slice of the file, right after the header with the size of the array.
+ *
+ *  \param file mpi file handle of the input file
+ *  \param sub_arr where the block will be stored
+ *  \param first index of the first element of the block in the array
+ *  \param count number of elements in the block
+ *
+ *  \return 1 if the whole block was read, 0 otherwise
+ */
+static int read_block(MPI_File file, int *sub_arr, int first, int count) {
+    MPI_Offset offset = (MPI_Offset)sizeof(int) * (1 + (MPI_Offset)first);
+    MPI_Status status;
+    int n_read;
+
+    if (MPI_File_read_at_all(file, offset, sub_arr, count, MPI_INT, &status) != MPI_SUCCESS) {
+        return 0;
+    }
+    MPI_Get_count(&status, MPI_INT, &n_read);
+    return n_read == count;
+}
+
+/**
+ *  \brief Compare-splits the local block with the block of the partner process.
+ *
+ *  Both processes exchange their blocks and keep the largest or the smallest half of the union. With more than one
+ *  piece, the blocks are exchanged in pieces with non-blocking messages, starting from the end where each process
+ *  starts merging, so that the merge advances as each piece arrives.
+ *
+ *  \param sub_arr local block, sorted in the given direction
+ *  \param partner_arr where the block of the partner process is received
+ *  \param merged_arr where the kept half is stored
+ *  \param count number of elements in each block
+ *  \param partner rank of the partner process
+ *  \param keep_high 1 to keep the largest elements, 0 to keep the smallest
+ *  \param direction 0 for descending order, 1 for ascending order
+ *  \param n_pieces number of pieces in which the blocks are exchanged
+ *  \param send_reqs requests of the sends of the pieces (n_pieces)
+ *  \param recv_reqs requests of the receives of the pieces (n_pieces)
+ */
+static void compare_split(int *sub_arr, int *partner_arr, int *merged_arr, int count, int partner, int keep_high,
+                          int direction, int n_pieces, MPI_Request *send_reqs, MPI_Request *recv_reqs) {
+    if (n_pieces <= 1) {
+        // exchange blocks with the partner process
+        MPI_Sendrecv(sub_arr, count, MPI_INT, partner, 0, partner_arr, count, MPI_INT, partner, 0, MPI_COMM_WORLD,
+                     MPI_STATUS_IGNORE);
+        merge_split(sub_arr, partner_arr, merged_arr, count, keep_high, direction);
+        return;
+    }
+
+    merge_split_state state;
+    merge_split_begin(&state, sub_arr, partner_arr, merged_arr, count, keep_high, direction);
+
+    // the partner merges from the opposite end, so the local block is sent starting from there
+    int piece_size = (count + n_pieces - 1) / n_pieces;
+    for (int i = 0; i < n_pieces; i++) {
+        int from = i * piece_size < count ? i * piece_size : count;
+        int to = (i + 1) * piece_size < count ? (i + 1) * piece_size : count;
+        int recv_start = state.from_front ? from : count - to;
+        int send_start = state.from_front ? count - to : from;
+        MPI_Irecv(partner_arr + recv_start, to - from, MPI_INT, partner, i, MPI_COMM_WORLD, &recv_reqs[i]);
+        MPI_Isend(sub_arr + send_start, to - from, MPI_INT, partner, i, MPI_COMM_WORLD, &send_reqs[i]);
+    }
+
+    // merge each piece as soon as it arrives
+    for (int i = 0; i < n_pieces; i++) {
+        MPI_Wait(&recv_reqs[i], MPI_STATUS_IGNORE);
+        int n_available = (i + 1) * piece_size < count ? (i + 1) * piece_size : count;
+        if (merge_split_advance(&state, n_available)) {
+            MPI_Waitall(n_pieces - i - 1, &recv_reqs[i + 1], MPI_STATUSES_IGNORE);
+            break;
+        }
+    }
+    MPI_Waitall(n_pieces, send_reqs, MPI_STATUSES_IGNORE);
+}
+
+/**
+ *  \brief Checks if the array, distributed in blocks over all processes, is sorted.
+ *
+ *  Each process checks its own block and the boundary with the first element of the next process.
+ *  The process that holds the first error reports it.
+ *
+ *  \param sub_arr block of this process
+ *  \param count number of elements in each block
+ *  \param direction 0 for descending order, 1 for ascending order
+ *  \param mpi_rank rank of this process
+ *  \param mpi_size number of processes
+ *
+ *  \return 1 if the array is sorted, 0 otherwise
+ */
+static int check_sorted(int *sub_arr, int count, int direction, int mpi_rank, int mpi_size) {
+    int next_first = 0;
+    int prev = mpi_rank > 0 ? mpi_rank - 1 : MPI_PROC_NULL;
+    int next = mpi_rank < mpi_size - 1 ? mpi_rank + 1 : MPI_PROC_NULL;
+
+    // send the first element to the previous process, receive the first element of the next process
+    MPI_Sendrecv(&sub_arr[0], 1, MPI_INT, prev, 0, &next_first, 1, MPI_INT, next, 0, MPI_COMM_WORLD,
+                 MPI_STATUS_IGNORE);
+
+    // find the first local error
+    int n_checks = next == MPI_PROC_NULL ? count - 1 : count;
+    int error = INT_MAX;
+    for (int i = 0; i < n_checks; i++) {
+        int a = sub_arr[i], b = i + 1 < count ? sub_arr[i + 1] : next_first;
+        if ((a < b && direction == DESCENDING) || (a > b && direction == ASCENDING)) {
+            error = i;
+            break;
+        }
+    }
+
+    // the first error overall is reported by the process that holds it
+    long local_error = error == INT_MAX ? LONG_MAX : (long)mpi_rank * count + error;
+    long first_error;
+    MPI_Allreduce(&local_error, &first_error, 1, MPI_LONG, MPI_MIN, MPI_COMM_WORLD);
+    if (first_error != LONG_MAX && first_error == local_error) {
+        fprintf(stderr, "Error in position %ld between element %d and %d\n", first_error, sub_arr[error],
+                error + 1 < count ? sub_arr[error + 1] : next_first);
+    }
+    return first_error == LONG_MAX;
+}
+
 /**
  *  \brief Main function of the program.
  *
  *  Lifecycle:
  *  - initialize mpi variables
  *  - rank 0: process program arguments
- *  - rank 0: read the array from the file
- *  - inilialize mpi group
+ *  - rank 0: broadcast the input file path and the options
+ *  - rank 0: read the size of the array from the file header
  *  - rank 0: broadcast the size of the array
+ *  - mpi-io collective read of the balanced block of each process, padded with sentinels
  *  - rank 0: start time
- *  - mpi scatter/gather to bitonic sort each part of the array
- *  - group processes involved in merge tasks
- *  - terminate processes not involved
- *  - mpi scatter/gather to bitonic merge each part of the array until it's sorted
+ *  - make each process sort its block (bitonic, radix or intro sort)
+ *  - for each merge level, compare-split the block with each hypercube partner of the level
  *  - rank 0: stop time
- *  - rank 0: check if the array is sorted
+ *  - check if the distributed array is sorted
  *
  *  \param argc number of command line arguments
  *  \param argv array of command line arguments
@@ -81,34 +221,42 @@ int main(int argc, char *argv[]) {
     // program arguments
     char *cmd_name = argv[0];
     char *file_path = NULL;
+    int file_path_len = 0;
+    int n_pieces = 1;
+    int n_threads = 1;
+    int local_sort = LOCAL_SORT_BITONIC;
 
     // mpi arguments
     int mpi_rank, mpi_size;
 
-    // mpi comm and group
-    MPI_Comm curr_comm = MPI_COMM_WORLD, next_comm;
-    MPI_Group curr_group, next_group;
-    int *group_members = NULL;
-
-    // initialize mpi
-    MPI_Init(&argc, &argv);
+    // initialize mpi, only the main thread of each process makes mpi calls
+    int thread_support;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &thread_support);
     MPI_Comm_rank(MPI_COMM_WORLD, &mpi_rank);
     MPI_Comm_size(MPI_COMM_WORLD, &mpi_size);
 
-    if (mpi_rank == 0 && (mpi_size & (mpi_size - 1)) != 0) {
-        fprintf(stderr, "Invalid number of processes\n");
-        printUsage(cmd_name);
+    if (mpi_rank == 0 && thread_support < MPI_THREAD_FUNNELED) {
+        fprintf(stderr, "The mpi library does not support threads\n");
         MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
     }
 
+    // select the sorting network kernel before any parallel region uses it
+    simd_init();
+
     int direction = DESCENDING;
-    int *arr = NULL, size;
+    int size;
 
     if (mpi_rank == 0) {
+        // each piece of an exchange has its own tag, so the number of pieces is bounded by the largest tag
+        int *tag_ub, has_tag_ub;
+        int max_pieces = MAX_PIECES;
+        MPI_Comm_get_attr(MPI_COMM_WORLD, MPI_TAG_UB, &tag_ub, &has_tag_ub);
+        if (has_tag_ub && *tag_ub < max_pieces - 1) max_pieces = *tag_ub + 1;
+
         // process program arguments
         int opt;
         do {
-            switch ((opt = getopt(argc, argv, "f:h"))) {
+            switch ((opt = getopt_long(argc, argv, "f:t:s:h", long_options, NULL))) {
                 case 'f':
                     file_path = optarg;
                     if (file_path == NULL) {
@@ -117,6 +265,39 @@ int main(int argc, char *argv[]) {
                         MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
                     }
                     break;
+                case 't':
+                    n_threads = atoi(optarg);
+                    if (n_threads < 1) {
+                        fprintf(stderr, "Invalid number of threads\n");
+                        printUsage(cmd_name);
+                        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+                    }
+#ifndef _OPENMP
+                    if (n_threads > 1) {
+                        fprintf(stderr, "Compiled without OpenMP, only 1 thread per process is used\n");
+                        n_threads = 1;
+                    }
+#endif
+                    break;
+                case 's':
+                    n_pieces = atoi(optarg);
+                    if (n_pieces < 1 || n_pieces > max_pieces) {
+                        fprintf(stderr, "Invalid number of pieces (between 1 and %d)\n", max_pieces);
+                        printUsage(cmd_name);
+                        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+                    }
+                    break;
+                case 'l':
+                    local_sort = -1;
+                    for (int i = 0; i < (int)(sizeof(local_sort_names) / sizeof(local_sort_names[0])); i++) {
+                        if (strcmp(optarg, local_sort_names[i]) == 0) local_sort = i;
+                    }
+                    if (local_sort < 0) {
+                        fprintf(stderr, "Invalid local sort %s\n", optarg);
+                        printUsage(cmd_name);
+                        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+                    }
+                    break;
                 case 'h':
                     printUsage(cmd_name);
                     MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
@@ -137,160 +318,207 @@ int main(int argc, char *argv[]) {
         // print program arguments
         fprintf(stdout, "%-16s : %s\n", "Input file", file_path);
         fprintf(stdout, "%-16s : %d\n", "Processes", mpi_size);
+        fprintf(stdout, "%-16s : %d\n", "Threads", n_threads);
+        fprintf(stdout, "%-16s : %d\n", "Pieces", n_pieces);
+        fprintf(stdout, "%-16s : %s\n", "Local sort", local_sort_names[local_sort]);
+
+        file_path_len = (int)strlen(file_path) + 1;
+    }
 
-        // open the file
-        FILE *file = fopen(file_path, "rb");
-        if (file == NULL) {
-            fprintf(stderr, "Could not open file %s\n", file_path);
+    // broadcast the input file path
+    MPI_Bcast(&file_path_len, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (mpi_rank != 0) {
+        file_path = (char *)malloc(file_path_len * sizeof(char));
+        if (file_path == NULL) {
+            fprintf(stderr, "[PROC-%d] Could not allocate memory for the file path\n", mpi_rank);
             MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
         }
+    }
+    MPI_Bcast(file_path, file_path_len, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    // broadcast the number of pieces of each exchange
+    MPI_Bcast(&n_pieces, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    // broadcast the local sort algorithm
+    MPI_Bcast(&local_sort, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    // broadcast the number of threads of each process
+    MPI_Bcast(&n_threads, 1, MPI_INT, 0, MPI_COMM_WORLD);
+#ifdef _OPENMP
+    omp_set_num_threads(n_threads);
+#endif
+
+    // open the file
+    MPI_File file;
+    if (MPI_File_open(MPI_COMM_WORLD, file_path, MPI_MODE_RDONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+        if (mpi_rank == 0) fprintf(stderr, "Could not open file %s\n", file_path);
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+
+    if (mpi_rank == 0) {
         // read the size of the array
-        int size;
-        if (fread(&size, sizeof(int), 1, file) != 1) {
+        MPI_Status status;
+        int n_read = 0;
+        if (MPI_File_read_at(file, 0, &size, 1, MPI_INT, &status) == MPI_SUCCESS) {
+            MPI_Get_count(&status, MPI_INT, &n_read);
+        }
+        if (n_read != 1) {
             fprintf(stderr, "Could not read the size of the array\n");
-            fclose(file);
             MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
         }
-        // size must be power of 2
-        if ((size & (size - 1)) != 0) {
-            fprintf(stderr, "The size of the array must be a power of 2\n");
-            fclose(file);
+        // the array may be empty, but its size cannot be negative
+        if (size < 0) {
+            fprintf(stderr, "The size of the array cannot be negative\n");
             MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
         }
         fprintf(stdout, "%-16s : %d\n", "Array size", size);
-        // allocate memory for the array
-        arr = (int *)malloc(size * sizeof(int));
-        if (arr == NULL) {
-            fprintf(stderr, "Could not allocate memory for the array\n");
-            fclose(file);
-            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
-        }
-        // load array into memory
-        int num, ni = 0;
-        while (fread(&num, sizeof(int), 1, file) == 1 && ni < size) {
-            arr[ni++] = num;
-        }
-        // close the file
-        fclose(file);
     }
 
-    // intialize process group
-    group_members = (int *)malloc(mpi_size * sizeof(int));
-    if (group_members == NULL) {
-        fprintf(stderr, "[PROC-%d] Could not allocate memory for the process group\n", mpi_rank);
-        if (mpi_rank == 0) free(arr);
-        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
-    }
-    for (int i = 0; i < mpi_size; i++) {
-        group_members[i] = i;
+    // broadcast the size of the array
+    MPI_Bcast(&size, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    // an empty array is already sorted
+    if (size == 0) {
+        MPI_File_close(&file);
+        if (mpi_rank != 0) free(file_path);
+        if (mpi_rank == 0) {
+            fprintf(stdout, "The array is empty, there is nothing to sort\n");
+        }
+        MPI_Finalize();
+        return EXIT_SUCCESS;
     }
 
-    // initialize mpi group and comm
-    MPI_Comm_group(curr_comm, &curr_group);
+    /* the array is split as evenly as possible: the first size % mpi_size processes read one more element
+       all blocks are padded to the same count with sentinels, which are sorted to the end of the array */
 
-    // broadcast the size of the array
-    MPI_Bcast(&size, 1, MPI_INT, 0, curr_comm);
+    long padded_count = ((long)size + mpi_size - 1) / mpi_size;
 
-    if (mpi_rank == 0) {
-        // START TIME
-        get_delta_time();
+    // the bitonic local sort needs a power of 2 number of elements, the extra room is filled with sentinels
+    long padded_capacity = padded_count;
+    if (local_sort == LOCAL_SORT_BITONIC) {
+        while ((padded_capacity & (padded_capacity - 1)) != 0) padded_capacity += padded_capacity & -padded_capacity;
     }
 
-    if (size > 1) {
-        int count = size / mpi_size;
-
-        // allocate memory for the sub-array
-        int *sub_arr = (int *)malloc(count * sizeof(int));
-        if (sub_arr == NULL) {
-            fprintf(stderr, "[PROC-%d] Could not allocate memory for the sub-array\n", mpi_rank);
-            if (mpi_rank == 0) free(arr);
-            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    if (padded_capacity > MAX_BLOCK_SIZE) {
+        if (mpi_rank == 0) {
+            fprintf(stderr, "The block of each process has %ld elements, padding included, but the maximum is %d "
+                    "(use more processes)\n", padded_capacity, MAX_BLOCK_SIZE);
         }
+        MPI_File_close(&file);
+        if (mpi_rank != 0) free(file_path);
+        MPI_Finalize();
+        return EXIT_FAILURE;
+    }
 
-        /* divide the array into mpi_size parts
-           make each process bitonic sort one part */
-
-        // scatter the array into mpi_size parts
-        MPI_Scatter(arr, count, MPI_INT, sub_arr, count, MPI_INT, 0, curr_comm);
-
-        // direction of the sub-sort
-        int sub_direction = (mpi_rank % 2 == 0) == direction;
-
-        // make each process bitonic sort one part
-        bitonic_sort(sub_arr, 0, count, sub_direction);
-
-        // gather the sorted parts
-        MPI_Gather(sub_arr, count, MPI_INT, arr, count, MPI_INT, 0, curr_comm);
-
-        /* perform a bitonic merge of the sorted parts
-           make each process bitonic merge one part */
-
-        for (count *= 2; count <= size; count *= 2) {
-            int n_merge_tasks = size / count;
-
-            // reallocate memory for the sub-array
-            sub_arr = (int *)realloc(sub_arr, count * sizeof(int));
-            if (sub_arr == NULL) {
-                fprintf(stderr, "[PROC-%d] Could not reallocate memory for the sub-array\n", mpi_rank);
-                free(sub_arr);
-                if (mpi_rank == 0) free(arr);
-                MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
-            }
-
-            // group processes involved in merge tasks
-            MPI_Group_incl(curr_group, n_merge_tasks, group_members, &next_group);
-            MPI_Comm_create(curr_comm, next_group, &next_comm);
-            curr_group = next_group;
-            curr_comm = next_comm;
+    int count = (int)padded_count;
+    int capacity = (int)padded_capacity;
+    int n_real = size / mpi_size + (mpi_rank < size % mpi_size);
+    int first = mpi_rank * (size / mpi_size) + (mpi_rank < size % mpi_size ? mpi_rank : size % mpi_size);
+    int sentinel = direction == DESCENDING ? INT_MIN : INT_MAX;
+    if (n_pieces > count) n_pieces = count;
+
+    if (mpi_rank == 0 && padded_capacity * mpi_size > size) {
+        // report the padding overhead: the sentinels of the blocks, and the extra room of the bitonic local sort
+        long block_padding = padded_count * mpi_size - size;
+        long sort_padding = (padded_capacity - padded_count) * mpi_size;
+        fprintf(stdout, "%-16s : %ld elements (%.2f%%)\n", "Block padding", block_padding, 100.0 * block_padding / size);
+        fprintf(stdout, "%-16s : %ld elements (%.2f%%)\n", "Sort padding", sort_padding, 100.0 * sort_padding / size);
+    }
 
-            // terminate processes not involved
-            if (mpi_rank >= n_merge_tasks) {
-                break;
-            }
+    // allocate memory for the local block, the block received from the partner process and the merged block
+    int *sub_arr = (int *)malloc(capacity * sizeof(int));
+    int *partner_arr = (int *)malloc(count * sizeof(int));
+    int *merged_arr = (int *)malloc(capacity * sizeof(int));
+    if (sub_arr == NULL || partner_arr == NULL || merged_arr == NULL) {
+        fprintf(stderr, "[PROC-%d] Could not allocate memory for the sub-array\n", mpi_rank);
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
 
-            // set communicator size
-            MPI_Comm_size(curr_comm, &n_merge_tasks);
+    // allocate the requests of the pieces of each exchange
+    MPI_Request *send_reqs = (MPI_Request *)malloc(n_pieces * sizeof(MPI_Request));
+    MPI_Request *recv_reqs = (MPI_Request *)malloc(n_pieces * sizeof(MPI_Request));
+    if (send_reqs == NULL || recv_reqs == NULL) {
+        fprintf(stderr, "[PROC-%d] Could not allocate memory for the requests\n", mpi_rank);
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
 
-            if (n_merge_tasks > 1) {
-                // scatter the array into n_merge_tasks parts
-                MPI_Scatter(arr, count, MPI_INT, sub_arr, count, MPI_INT, 0, curr_comm);
+    /* divide the array into mpi_size blocks
+       each process reads its block and keeps it until the array is sorted */
 
-                // direction of the sub-merge
-                int sub_direction = (mpi_rank % 2 == 0) == direction;
+    for (int i = n_real; i < capacity; i++) {
+        sub_arr[i] = sentinel;
+    }
+    if (!read_block(file, sub_arr, first, n_real)) {
+        fprintf(stderr, "[PROC-%d] Could not read the block of the array\n", mpi_rank);
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+    MPI_File_close(&file);
+    if (mpi_rank != 0) free(file_path);
 
-                // make each worker process bitonic merge one part
-                bitonic_merge(sub_arr, 0, count, sub_direction);
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (mpi_rank == 0) {
+        // START TIME
+        get_delta_time();
+    }
 
-                // gather the merged parts
-                MPI_Gather(sub_arr, count, MPI_INT, arr, count, MPI_INT, 0, curr_comm);
-            }
-            else {
-                // direction of the sub-merge
-                int sub_direction = (mpi_rank % 2 == 0) == direction;
+    // make each process sort its block, all blocks in the same direction
+    switch (local_sort) {
+        case LOCAL_SORT_RADIX:
+            radix_sort(sub_arr, partner_arr, count, direction);
+            break;
+        case LOCAL_SORT_INTRO:
+            intro_sort(sub_arr, count, direction);
+            break;
+        default:
+            // the sentinels of the extra room are sorted past the end of the block
+            bitonic_sort(sub_arr, 0, capacity, direction);
+            break;
+    }
 
-                // make each worker process bitonic merge one part
-                bitonic_merge(arr, 0, count, sub_direction);
-            }
+    /* perform a bitonic merge of the sorted blocks, over the next power of 2 number of processes
+       at each merge level, the first compare-split of each group pairs mirrored processes, so that the lower process
+       always keeps the elements that come first in the sort direction
+       the missing processes hold only sentinels, which a real process, always the lower one, would keep to the end,
+       so their compare-splits are skipped
+       each compare-split keeps both blocks sorted, so no local merge is needed */
+
+    for (int merge_size = 2; merge_size / 2 < mpi_size; merge_size *= 2) {
+        for (int distance = merge_size / 2; distance > 0; distance /= 2) {
+            int partner = distance == merge_size / 2 ? mpi_rank ^ (merge_size - 1) : mpi_rank ^ distance;
+            if (partner >= mpi_size) continue;
+
+            // the lower process keeps the elements that come first in the sort direction
+            int keep_high = (mpi_rank < partner) == (direction == DESCENDING);
+            compare_split(sub_arr, partner_arr, merged_arr, count, partner, keep_high, direction, n_pieces, send_reqs,
+                          recv_reqs);
+
+            // the merged block becomes the local block
+            int *temp = sub_arr;
+            sub_arr = merged_arr;
+            merged_arr = temp;
         }
-
-        free(sub_arr);
     }
 
+    MPI_Barrier(MPI_COMM_WORLD);
     if (mpi_rank == 0) {
         // END TIME
         fprintf(stdout, "%-16s : %.9f seconds\n", "Time elapsed", get_delta_time());
+    }
 
-        // check if the array is sorted
-        for (int i = 0; i < size - 1; i++) {
-            if ((arr[i] < arr[i + 1] && direction == DESCENDING) || (arr[i] > arr[i + 1] && direction == ASCENDING)) {
-                fprintf(stderr, "Error in position %d between element %d and %d\n", i, arr[i], arr[i + 1]);
-                free(arr);
-                MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
-            }
-        }
-        fprintf(stdout, "The array is sorted, everything is OK! :)\n");
+    // check if the array is sorted
+    int sorted = check_sorted(sub_arr, count, direction, mpi_rank, mpi_size);
 
-        free(arr);
+    free(sub_arr);
+    free(partner_arr);
+    free(merged_arr);
+    free(send_reqs);
+    free(recv_reqs);
+
+    if (!sorted) {
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+    if (mpi_rank == 0) {
+        fprintf(stdout, "The array is sorted, everything is OK! :)\n");
     }
 
     MPI_Finalize();
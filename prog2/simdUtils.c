@@ -0,0 +1,269 @@
+/**
+ *  \file simdUtils.c (implementation file)
+ *
+ *  \brief Assignment 2.2: mpi-based bitonic sort.
+ *
+ *  This file contains the implementation of the in-register sorting networks used as the base case of the bitonic
+ *  sort, for 8 and 16 integers.
+ *
+ *  Each network is the bitonic network itself: a compare-exchange stage at distance j pairs every lane with the lane
+ *  j positions away (a shuffle), computes the min and the max of both, and blends them back according to which lanes
+ *  keep the largest element. The avx2 kernels work on 8 lanes per register, the sse4.1 kernels on 4.
+ *
+ *  \author João Fonseca
+ *  \author Rafael Gonçalves
+ */
+
+#include "simdUtils.h"
+
+#include "const.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+/** \brief Compare-exchange of the lanes of v with the lanes of p, blend mask selects the lanes that keep the max */
+#define AVX2_CMPX(v, p, mask, dir)                                                  \
+    ((dir) ? _mm256_blend_epi32(_mm256_min_epi32(v, p), _mm256_max_epi32(v, p), mask) \
+           : _mm256_blend_epi32(_mm256_max_epi32(v, p), _mm256_min_epi32(v, p), mask))
+
+/** \brief Compare-exchange of the lanes of v with the lanes of p, blend mask (in 16-bit lanes) selects the max */
+#define SSE_CMPX(v, p, mask, dir)                                             \
+    ((dir) ? _mm_blend_epi16(_mm_min_epi32(v, p), _mm_max_epi32(v, p), mask) \
+           : _mm_blend_epi16(_mm_max_epi32(v, p), _mm_min_epi32(v, p), mask))
+
+/** \brief Swaps adjacent lanes */
+#define SHUFFLE_D1 0xB1
+
+/** \brief Swaps adjacent pairs of lanes */
+#define SHUFFLE_D2 0x4E
+
+/**
+ *  \brief Merges a bitonic vector of 8 integers (avx2).
+ *
+ *  \param v vector to be merged
+ *  \param direction 0 for descending order, 1 for ascending order
+ *
+ *  \return merged vector
+ */
+__attribute__((target("avx2"))) static inline __m256i avx2_merge8(__m256i v, int direction) {
+    v = AVX2_CMPX(v, _mm256_permute2x128_si256(v, v, 0x01), 0xF0, direction);
+    v = AVX2_CMPX(v, _mm256_shuffle_epi32(v, SHUFFLE_D2), 0xCC, direction);
+    v = AVX2_CMPX(v, _mm256_shuffle_epi32(v, SHUFFLE_D1), 0xAA, direction);
+    return v;
+}
+
+/**
+ *  \brief Sorts a vector of 8 integers (avx2).
+ *
+ *  \param v vector to be sorted
+ *  \param direction 0 for descending order, 1 for ascending order
+ *
+ *  \return sorted vector
+ */
+__attribute__((target("avx2"))) static inline __m256i avx2_sort8(__m256i v, int direction) {
+    // pairs in alternating directions
+    v = AVX2_CMPX(v, _mm256_shuffle_epi32(v, SHUFFLE_D1), 0x66, direction);
+    // quads in alternating directions
+    v = AVX2_CMPX(v, _mm256_shuffle_epi32(v, SHUFFLE_D2), 0x3C, direction);
+    v = AVX2_CMPX(v, _mm256_shuffle_epi32(v, SHUFFLE_D1), 0x5A, direction);
+    // the whole vector
+    return avx2_merge8(v, direction);
+}
+
+/**
+ *  \brief Merges a bitonic sequence of 16 integers held in two vectors (avx2).
+ *
+ *  \param a first half of the sequence
+ *  \param b second half of the sequence
+ *  \param direction 0 for descending order, 1 for ascending order
+ */
+__attribute__((target("avx2"))) static inline void avx2_merge16(__m256i *a, __m256i *b, int direction) {
+    __m256i lo = _mm256_min_epi32(*a, *b), hi = _mm256_max_epi32(*a, *b);
+    *a = avx2_merge8(direction ? lo : hi, direction);
+    *b = avx2_merge8(direction ? hi : lo, direction);
+}
+
+/**
+ *  \brief Sorts or merges 8 or 16 integers (avx2).
+ *
+ *  \param arr array to be sorted or merged
+ *  \param count number of elements in the array (8 or 16)
+ *  \param direction 0 for descending order, 1 for ascending order
+ *  \param sort 1 to sort, 0 to merge a bitonic array
+ */
+__attribute__((target("avx2"))) static void avx2_network(int *arr, int count, int direction, int sort) {
+    __m256i a = _mm256_loadu_si256((__m256i *)arr);
+    if (count == 8) {
+        a = sort ? avx2_sort8(a, direction) : avx2_merge8(a, direction);
+    }
+    else {
+        __m256i b = _mm256_loadu_si256((__m256i *)(arr + 8));
+        if (sort) {
+            a = avx2_sort8(a, direction);
+            b = avx2_sort8(b, !direction);
+        }
+        avx2_merge16(&a, &b, direction);
+        _mm256_storeu_si256((__m256i *)(arr + 8), b);
+    }
+    _mm256_storeu_si256((__m256i *)arr, a);
+}
+
+/**
+ *  \brief Merges a bitonic vector of 4 integers (sse4.1).
+ *
+ *  \param v vector to be merged
+ *  \param direction 0 for descending order, 1 for ascending order
+ *
+ *  \return merged vector
+ */
+__attribute__((target("sse4.1"))) static inline __m128i sse_merge4(__m128i v, int direction) {
+    v = SSE_CMPX(v, _mm_shuffle_epi32(v, SHUFFLE_D2), 0xF0, direction);
+    v = SSE_CMPX(v, _mm_shuffle_epi32(v, SHUFFLE_D1), 0xCC, direction);
+    return v;
+}
+
+/**
+ *  \brief Sorts a vector of 4 integers (sse4.1).
+ *
+ *  \param v vector to be sorted
+ *  \param direction 0 for descending order, 1 for ascending order
+ *
+ *  \return sorted vector
+ */
+__attribute__((target("sse4.1"))) static inline __m128i sse_sort4(__m128i v, int direction) {
+    // pairs in alternating directions
+    v = SSE_CMPX(v, _mm_shuffle_epi32(v, SHUFFLE_D1), 0x3C, direction);
+    // the whole vector
+    return sse_merge4(v, direction);
+}
+
+/**
+ *  \brief Compare-exchanges two vectors lane by lane (sse4.1).
+ *
+ *  \param a vector that keeps the elements that come first in the desired order
+ *  \param b vector that keeps the elements that come last in the desired order
+ *  \param direction 0 for descending order, 1 for ascending order
+ */
+__attribute__((target("sse4.1"))) static inline void sse_split(__m128i *a, __m128i *b, int direction) {
+    __m128i lo = _mm_min_epi32(*a, *b), hi = _mm_max_epi32(*a, *b);
+    *a = direction ? lo : hi;
+    *b = direction ? hi : lo;
+}
+
+/**
+ *  \brief Merges a bitonic sequence of 8 integers held in two vectors (sse4.1).
+ *
+ *  \param v two vectors with the sequence
+ *  \param direction 0 for descending order, 1 for ascending order
+ */
+__attribute__((target("sse4.1"))) static inline void sse_merge8(__m128i *v, int direction) {
+    sse_split(&v[0], &v[1], direction);
+    v[0] = sse_merge4(v[0], direction);
+    v[1] = sse_merge4(v[1], direction);
+}
+
+/**
+ *  \brief Sorts 8 integers held in two vectors (sse4.1).
+ *
+ *  \param v two vectors with the sequence
+ *  \param direction 0 for descending order, 1 for ascending order
+ */
+__attribute__((target("sse4.1"))) static inline void sse_sort8(__m128i *v, int direction) {
+    v[0] = sse_sort4(v[0], direction);
+    v[1] = sse_sort4(v[1], !direction);
+    sse_merge8(v, direction);
+}
+
+/**
+ *  \brief Sorts or merges 8 or 16 integers (sse4.1).
+ *
+ *  \param arr array to be sorted or merged
+ *  \param count number of elements in the array (8 or 16)
+ *  \param direction 0 for descending order, 1 for ascending order
+ *  \param sort 1 to sort, 0 to merge a bitonic array
+ */
+__attribute__((target("sse4.1"))) static void sse_network(int *arr, int count, int direction, int sort) {
+    __m128i v[4];
+    int n_vectors = count / 4;
+    for (int i = 0; i < n_vectors; i++) {
+        v[i] = _mm_loadu_si128((__m128i *)(arr + 4 * i));
+    }
+    if (count == 8) {
+        if (sort) {
+            sse_sort8(v, direction);
+        }
+        else {
+            sse_merge8(v, direction);
+        }
+    }
+    else {
+        if (sort) {
+            sse_sort8(&v[0], direction);
+            sse_sort8(&v[2], !direction);
+        }
+        sse_split(&v[0], &v[2], direction);
+        sse_split(&v[1], &v[3], direction);
+        sse_merge8(&v[0], direction);
+        sse_merge8(&v[2], direction);
+    }
+    for (int i = 0; i < n_vectors; i++) {
+        _mm_storeu_si128((__m128i *)(arr + 4 * i), v[i]);
+    }
+}
+
+#endif
+
+/** \brief Sorting network kernel, selected from the cpu features by simd_init */
+static void (*network)(int *arr, int count, int direction, int sort) = NULL;
+
+/**
+ *  \brief Selects the widest sorting network kernel supported by the cpu.
+ *
+ *  It must be called once before any thread sorts or merges, and until then no kernel is used.
+ */
+void simd_init(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        network = avx2_network;
+    }
+    else if (__builtin_cpu_supports("sse4.1")) {
+        network = sse_network;
+    }
+#endif
+}
+
+/**
+ *  \brief Sorts a small integer array in the desired order with an in-register sorting network.
+ *
+ *  The kernel (avx2, sse4.1 or none) is selected by simd_init from the cpu features.
+ *
+ *  \param arr array to be sorted
+ *  \param count number of elements in the array (8 or 16)
+ *  \param direction 0 for descending order, 1 for ascending order
+ *
+ *  \return 1 if the array was sorted, 0 if there is no kernel for this count on this cpu
+ */
+int simd_sort(int *arr, int count, int direction) {
+    if (network == NULL || (count != 8 && count != 16)) return 0;
+    network(arr, count, direction, 1);
+    return 1;
+}
+
+/**
+ *  \brief Merges a small bitonic integer array in the desired order with an in-register merging network.
+ *
+ *  The kernel (avx2, sse4.1 or none) is selected by simd_init from the cpu features.
+ *
+ *  \param arr array to be merged
+ *  \param count number of elements in the array (8 or 16)
+ *  \param direction 0 for descending order, 1 for ascending order
+ *
+ *  \return 1 if the array was merged, 0 if there is no kernel for this count on this cpu
+ */
+int simd_merge(int *arr, int count, int direction) {
+    if (network == NULL || (count != 8 && count != 16)) return 0;
+    network(arr, count, direction, 0);
+    return 1;
+}
@@ -0,0 +1,48 @@
+/**
+ *  \file simdUtils.h (interface file)
+ *
+ *  \brief Assignment 2.2: mpi-based bitonic sort.
+ *
+ *  This file contains the interface of the in-register sorting networks used as the base case of the bitonic sort.
+ *
+ *  \author João Fonseca
+ *  \author Rafael Gonçalves
+ */
+
+#ifndef SIMD_UTILS_H
+#define SIMD_UTILS_H
+
+/**
+ *  \brief Selects the widest sorting network kernel supported by the cpu.
+ *
+ *  It must be called once before any thread sorts or merges, and until then no kernel is used.
+ */
+extern void simd_init(void);
+
+/**
+ *  \brief Sorts a small integer array in the desired order with an in-register sorting network.
+ *
+ *  The kernel (avx2, sse4.1 or none) is selected by simd_init from the cpu features.
+ *
+ *  \param arr array to be sorted
+ *  \param count number of elements in the array (8 or 16)
+ *  \param direction 0 for descending order, 1 for ascending order
+ *
+ *  \return 1 if the array was sorted, 0 if there is no kernel for this count on this cpu
+ */
+extern int simd_sort(int *arr, int count, int direction);
+
+/**
+ *  \brief Merges a small bitonic integer array in the desired order with an in-register merging network.
+ *
+ *  The kernel (avx2, sse4.1 or none) is selected by simd_init from the cpu features.
+ *
+ *  \param arr array to be merged
+ *  \param count number of elements in the array (8 or 16)
+ *  \param direction 0 for descending order, 1 for ascending order
+ *
+ *  \return 1 if the array was merged, 0 if there is no kernel for this count on this cpu
+ */
+extern int simd_merge(int *arr, int count, int direction);
+
+#endif /* SIMD_UTILS_H */
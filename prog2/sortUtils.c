@@ -3,13 +3,26 @@
  *
  *  \brief Assignment 2.2: mpi-based bitonic sort.
  *
- *  This file contains the implementation of the bitonic sort and merge routines.
+ *  This file contains the implementation of the bitonic sort and merge routines, and of the local sorts.
  *
  *  \author João Fonseca
  *  \author Rafael Gonçalves
  */
 
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "const.h"
+#include "simdUtils.h"
+#include "sortUtils.h"
+
+#ifdef RECURSIVE_BITONIC
+
+/* recursive implementation, kept as the reference for benchmark_kernel.sh */
 
 /**
  *  \brief Merges two halves of an integer array in the desired order.
@@ -21,6 +34,8 @@
  */
 void bitonic_merge(int *arr, int low_index, int count, int direction) {  // NOLINT(*-no-recursion)
     if (count <= 1) return;
+    // small blocks are merged in registers
+    if (count <= SIMD_BLOCK_SIZE && simd_merge(arr + low_index, count, direction)) return;
     int half = count / 2;
     // move the numbers to the correct half
     for (int i = low_index; i < low_index + half; i++) {
@@ -46,6 +61,8 @@ void bitonic_merge(int *arr, int low_index, int count, int direction) {  // NOLI
  */
 void bitonic_sort(int *arr, int low_index, int count, int direction) {  // NOLINT(*-no-recursion)
     if (count <= 1) return;
+    // small blocks are sorted in registers
+    if (count <= SIMD_BLOCK_SIZE && simd_sort(arr + low_index, count, direction)) return;
     int half = count / 2;
     // sort left half in ascending order
     bitonic_sort(arr, low_index, half, ASCENDING);
@@ -53,4 +70,567 @@ void bitonic_sort(int *arr, int low_index, int count, int direction) {  // NOLIN
     bitonic_sort(arr, low_index + half, half, DESCENDING);
     // merge the two halves
     bitonic_merge(arr, low_index, count, direction);
-}
\ No newline at end of file
+}
+
+#else
+
+/**
+ *  \brief Gets the direction of a block at a given level of the bitonic network.
+ *
+ *  At each level, adjacent blocks are sorted in opposite directions so that each pair forms a bitonic sequence for
+ *  the next level. The block at the start of the array always follows the direction of the whole array.
+ *
+ *  \param start index of the first element of the block, relative to the start of the array
+ *  \param block_size number of elements in the block
+ *  \param direction 0 for descending order, 1 for ascending order (of the whole array)
+ *
+ *  \return direction of the block
+ */
+static inline int block_direction(int start, int block_size, int direction) {
+    return ((start & block_size) == 0) == direction;
+}
+
+/**
+ *  \brief Compare-exchanges the elements of two ranges, element by element.
+ *
+ *  \param lo range that keeps the elements that come first
+ *  \param hi range that keeps the elements that come last
+ *  \param count number of elements in each range
+ *  \param direction 0 for descending order, 1 for ascending order
+ */
+static inline void compare_exchange(int *lo, int *hi, int count, int direction) {
+    // branchless so that the compiler vectorizes it
+    for (int i = 0; i < count; i++) {
+        int a = lo[i], b = hi[i];
+        int min = a < b ? a : b, max = a < b ? b : a;
+        lo[i] = direction ? min : max;
+        hi[i] = direction ? max : min;
+    }
+}
+
+/**
+ *  \brief Compare-exchanges every pair of elements at a given distance, in blocks of twice that distance.
+ *
+ *  \param arr array to be updated
+ *  \param count number of elements in the array
+ *  \param distance distance between the elements of each pair
+ *  \param direction 0 for descending order, 1 for ascending order
+ */
+static void compare_exchange_pass(int *arr, int count, int distance, int direction) {
+    for (int start = 0; start < count; start += 2 * distance) {
+        compare_exchange(arr + start, arr + start + distance, distance, direction);
+    }
+}
+
+/**
+ *  \brief Compare-exchanges every pair of elements at a given distance, over the whole array, with all threads.
+ *
+ *  The pairs are split in segments of at most CACHE_TILE_SIZE pairs, which are shared among the threads.
+ *
+ *  \param arr array to be updated
+ *  \param count number of elements in the array
+ *  \param distance distance between the elements of each pair
+ *  \param block_size number of elements of the bitonic blocks being merged, which give the direction of each pair
+ *  \param direction 0 for descending order, 1 for ascending order (of the whole array)
+ */
+static void compare_exchange_level(int *arr, int count, int distance, int block_size, int direction) {
+    // a segment never crosses the end of the lower half of a pair of blocks of 2 * distance elements
+    int segment = distance < CACHE_TILE_SIZE ? distance : CACHE_TILE_SIZE;
+
+#pragma omp parallel for schedule(static)
+    for (int pair = 0; pair < count / 2; pair += segment) {
+        int start = pair / distance * 2 * distance + pair % distance;
+        compare_exchange(arr + start, arr + start + distance, segment, block_direction(start, block_size, direction));
+    }
+}
+
+/**
+ *  \brief Merges a bitonic integer array that fits in the cache, finishing every stage before returning.
+ *
+ *  \param arr array to be merged
+ *  \param count number of elements in the array
+ *  \param direction 0 for descending order, 1 for ascending order
+ */
+static void merge_in_cache(int *arr, int count, int direction) {
+    for (int block_size = count; block_size > 1; block_size /= 2) {
+        // the last stages are done in registers, one block at a time
+        if (block_size <= SIMD_BLOCK_SIZE && simd_merge(arr, block_size, direction)) {
+            for (int start = block_size; start < count; start += block_size) {
+                simd_merge(arr + start, block_size, direction);
+            }
+            return;
+        }
+        compare_exchange_pass(arr, count, block_size / 2, direction);
+    }
+}
+
+/**
+ *  \brief Sorts an integer array that fits in the cache.
+ *
+ *  \param arr array to be sorted
+ *  \param count number of elements in the array
+ *  \param direction 0 for descending order, 1 for ascending order
+ */
+static void sort_in_cache(int *arr, int count, int direction) {
+    int block_size = count < SIMD_BLOCK_SIZE ? count : SIMD_BLOCK_SIZE;
+
+    // the first levels are done in registers, one block at a time
+    if (simd_sort(arr, block_size, block_direction(0, block_size, direction))) {
+        for (int start = block_size; start < count; start += block_size) {
+            simd_sort(arr + start, block_size, block_direction(start, block_size, direction));
+        }
+    }
+    else {
+        block_size = 1;
+    }
+
+    // merge adjacent blocks, each level doubles the size of the sorted blocks
+    for (block_size *= 2; block_size <= count; block_size *= 2) {
+        for (int start = 0; start < count; start += block_size) {
+            merge_in_cache(arr + start, block_size, block_direction(start, block_size, direction));
+        }
+    }
+}
+
+/**
+ *  \brief Merges every bitonic block of an integer array, adjacent blocks in opposite directions.
+ *
+ *  The stages whose compare distance does not fit in a tile of CACHE_TILE_SIZE elements stream through the whole
+ *  array. The remaining stages are done tile by tile, while each tile is in the cache. Both are shared among the
+ *  threads over all blocks at once, so that even a single block keeps every thread busy.
+ *
+ *  \param arr array to be merged
+ *  \param count number of elements in the array
+ *  \param block_size number of elements in each block
+ *  \param direction 0 for descending order, 1 for ascending order (of the whole array)
+ */
+static void merge_blocks(int *arr, int count, int block_size, int direction) {
+    int tile_size = block_size;
+    for (; tile_size > CACHE_TILE_SIZE; tile_size /= 2) {
+        compare_exchange_level(arr, count, tile_size / 2, block_size, direction);
+    }
+
+#pragma omp parallel for schedule(static)
+    for (int start = 0; start < count; start += tile_size) {
+        merge_in_cache(arr + start, tile_size, block_direction(start, block_size, direction));
+    }
+}
+
+/**
+ *  \brief Merges two halves of an integer array in the desired order.
+ *
+ *  \param arr array to be merged
+ *  \param low_index index of the first element of the array
+ *  \param count number of elements in the array
+ *  \param direction 0 for descending order, 1 for ascending order
+ */
+void bitonic_merge(int *arr, int low_index, int count, int direction) {
+    if (count <= 1) return;
+    merge_blocks(arr + low_index, count, count, direction);
+}
+
+/**
+ *  \brief Sorts an integer array in the desired order.
+ *
+ *  Each tile of CACHE_TILE_SIZE elements is sorted while it is in the cache, then the tiles are merged level by level.
+ *  The tiles, and the work of each level, are shared among the threads.
+ *
+ *  \param arr array to be sorted
+ *  \param low_index index of the first element of the array
+ *  \param count number of elements in the array
+ *  \param direction 0 for descending order, 1 for ascending order
+ */
+void bitonic_sort(int *arr, int low_index, int count, int direction) {
+    if (count <= 1) return;
+    arr += low_index;
+
+    // sort each tile, adjacent tiles in opposite directions
+    int tile_size = count < CACHE_TILE_SIZE ? count : CACHE_TILE_SIZE;
+#pragma omp parallel for schedule(static)
+    for (int start = 0; start < count; start += tile_size) {
+        sort_in_cache(arr + start, tile_size, block_direction(start, tile_size, direction));
+    }
+
+    // merge adjacent tiles, each level doubles the size of the sorted blocks
+    for (int block_size = 2 * tile_size; block_size <= count; block_size *= 2) {
+        merge_blocks(arr, count, block_size, direction);
+    }
+}
+
+#endif
+
+/**
+ *  \brief Gets the number of local elements among the first elements taken by a merge-split.
+ *
+ *  \param local local block, walked from the end that holds the kept elements (see merge_split)
+ *  \param remote remote block, walked from the same end
+ *  \param step 1 to walk the blocks from the front, -1 from the back
+ *  \param count number of elements in each block
+ *  \param flip 0 to take the largest elements first, -1 to take the smallest
+ *  \param n_taken number of elements taken
+ *
+ *  \return number of local elements among them
+ */
+static int merge_split_rank(const int *local, const int *remote, int step, int count, int flip, int n_taken) {
+    int low = n_taken > count ? n_taken - count : 0, high = n_taken < count ? n_taken : count;
+    while (low < high) {
+        int mid = (low + high) / 2, n_remote = n_taken - mid;
+        // the local element at mid is taken before the remote element at n_remote - 1, so it is among them
+        if (n_remote > 0 && (local[step * mid] ^ flip) >= (remote[step * (n_remote - 1)] ^ flip)) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/**
+ *  \brief Merges the ranges of a segment of a merge-split together (see merge_split).
+ *
+ *  \param local local block, walked from the end that holds the kept elements
+ *  \param remote remote block, walked from the same end
+ *  \param merged where the kept half is stored, walked from the same end
+ *  \param step 1 to walk the blocks from the front, -1 from the back (a constant, so that each case is specialized)
+ *  \param count number of elements in each block
+ *  \param flip 0 to take the largest elements first, -1 to take the smallest
+ *  \param begin number of elements taken before the segment
+ *  \param end number of elements taken after the segment
+ */
+static inline void merge_split_paths(const int *local, const int *remote, int *merged, const int step, int count,
+                                     int flip, int begin, int end) {
+    // starting point of each range
+    int n_local[MERGE_PATHS], n_remote[MERGE_PATHS], n_merged[MERGE_PATHS + 1];
+    for (int p = 0; p <= MERGE_PATHS; p++) {
+        n_merged[p] = begin + (int)((long long)(end - begin) * p / MERGE_PATHS);
+        if (p < MERGE_PATHS) {
+            n_local[p] = merge_split_rank(local, remote, step, count, flip, n_merged[p]);
+            n_remote[p] = n_merged[p] - n_local[p];
+        }
+    }
+
+    // merge all ranges together, as far as the shortest one goes
+    int length = (end - begin) / MERGE_PATHS;
+    for (int i = 0; i < length; i++) {
+        for (int p = 0; p < MERGE_PATHS; p++) {
+            int a = local[step * n_local[p]], b = remote[step * n_remote[p]];
+            int take_local = (a ^ flip) >= (b ^ flip);
+            merged[step * (n_merged[p] + i)] = take_local ? a : b;
+            n_local[p] += take_local;
+            n_remote[p] += !take_local;
+        }
+    }
+
+    // finish the longer ranges
+    for (int p = 0; p < MERGE_PATHS; p++) {
+        for (int i = n_merged[p] + length; i < n_merged[p + 1]; i++) {
+            int a = local[step * n_local[p]], b = remote[step * n_remote[p]];
+            int take_local = (a ^ flip) >= (b ^ flip);
+            merged[step * i] = take_local ? a : b;
+            n_local[p] += take_local;
+            n_remote[p] += !take_local;
+        }
+    }
+}
+
+/**
+ *  \brief Keeps the largest or the smallest half of two sorted blocks, in linear time.
+ *
+ *  Both blocks are walked from the end that holds the kept elements, always taking the largest (or smallest) of the
+ *  two candidates. Each step depends on the previous comparison, so the output is split in MERGE_PATHS ranges, whose
+ *  starting points are found by binary search, and the ranges are merged in the same loop to overlap their latency.
+ *  The output is first split in the same way in one segment per thread.
+ *
+ *  \param local local block, sorted in the given direction
+ *  \param remote block received from the partner process, sorted in the same direction
+ *  \param merged where the kept half is stored, sorted in the same direction
+ *  \param count number of elements in each block
+ *  \param keep_high 1 to keep the largest elements, 0 to keep the smallest
+ *  \param direction 0 for descending order, 1 for ascending order
+ */
+void merge_split(const int *local, const int *remote, int *merged, int count, int keep_high, int direction) {
+    // flipping all bits reverses the order, so the smallest elements can be taken with the same comparison
+    int flip = keep_high ? 0 : -1;
+
+#pragma omp parallel
+    {
+        int n_threads = 1, thread = 0;
+#ifdef _OPENMP
+        n_threads = omp_get_num_threads();
+        thread = omp_get_thread_num();
+#endif
+        int begin = (int)((long long)count * thread / n_threads);
+        int end = (int)((long long)count * (thread + 1) / n_threads);
+
+        // the largest elements are at the front of a descending block, the smallest at the front of an ascending one
+        if (keep_high == (direction == DESCENDING)) {
+            merge_split_paths(local, remote, merged, 1, count, flip, begin, end);
+        }
+        else {
+            // walk the blocks from the back by mirroring the indices
+            merge_split_paths(local + count - 1, remote + count - 1, merged + count - 1, -1, count, flip, begin, end);
+        }
+    }
+}
+
+/**
+ *  \brief Starts a merge-split whose remote block arrives in pieces.
+ *
+ *  The remote block must arrive starting from the end given by state->from_front (the front if 1, the back if 0).
+ *
+ *  \param state state of the merge-split
+ *  \param local local block, sorted in the given direction
+ *  \param remote block received from the partner process, sorted in the same direction
+ *  \param merged where the kept half is stored, sorted in the same direction
+ *  \param count number of elements in each block
+ *  \param keep_high 1 to keep the largest elements, 0 to keep the smallest
+ *  \param direction 0 for descending order, 1 for ascending order
+ */
+void merge_split_begin(merge_split_state *state, const int *local, const int *remote, int *merged, int count,
+                       int keep_high, int direction) {
+    state->local = local;
+    state->remote = remote;
+    state->merged = merged;
+    state->count = count;
+    state->keep_high = keep_high;
+    // the largest elements are at the front of a descending block, the smallest at the front of an ascending one
+    state->from_front = keep_high == (direction == DESCENDING);
+    state->n_local = 0;
+    state->n_remote = 0;
+}
+
+/**
+ *  \brief Continues a merge-split as far as the remote elements that already arrived allow.
+ *
+ *  Both blocks are walked from the end that holds the kept elements, always taking the largest (or smallest) of the
+ *  two candidates, until count elements are taken. Neither block can run out before that.
+ *
+ *  \param state state of the merge-split
+ *  \param n_available number of remote elements that already arrived, counted from the end where the merge starts
+ *
+ *  \return 1 if the merge-split is finished, 0 otherwise
+ */
+int merge_split_advance(merge_split_state *state, int n_available) {
+    int count = state->count, keep_high = state->keep_high;
+    int n_local = state->n_local, n_remote = state->n_remote;
+
+    // walk the blocks from the back by mirroring the indices
+    int step = state->from_front ? 1 : -1, first = state->from_front ? 0 : count - 1;
+    const int *local = state->local + first, *remote = state->remote + first;
+    int *merged = state->merged + first;
+
+    while (n_local + n_remote < count && n_remote < n_available) {
+        int a = local[step * n_local], b = remote[step * n_remote];
+        int take_local = keep_high ? a >= b : a <= b;
+        merged[step * (n_local + n_remote)] = take_local ? a : b;
+        n_local += take_local;
+        n_remote += !take_local;
+    }
+
+    state->n_local = n_local;
+    state->n_remote = n_remote;
+    return n_local + n_remote == count;
+}
+
+/**
+ *  \brief Sorts an integer array in the desired order with a least significant digit radix sort.
+ *
+ *  The keys are sorted one byte at a time, as unsigned integers. Flipping the sign bit makes the order of negative
+ *  integers come before the positive ones, and flipping the other bits as well reverses the order, so both directions
+ *  are sorted in ascending order of the key. Bytes that are the same in all elements are skipped. Each thread counts and
+ *  moves its own slice of the array.
+ *
+ *  \param arr array to be sorted
+ *  \param temp buffer with room for count elements
+ *  \param count number of elements in the array
+ *  \param direction 0 for descending order, 1 for ascending order
+ */
+void radix_sort(int *arr, int *temp, int count, int direction) {
+    if (count <= 1) return;
+    uint32_t flip = direction == ASCENDING ? 0x80000000u : 0x7FFFFFFFu;
+
+    int n_threads = 1;
+#ifdef _OPENMP
+    n_threads = omp_get_max_threads();
+#endif
+
+    // each thread counts and moves the elements of its own slice, in order, so that the sort stays stable
+    int histogram[n_threads][256];
+    int *src = arr, *dst = temp;
+    for (int byte = 0; byte < 4; byte++) {
+        int shift = 8 * byte, skip = 0;
+
+#pragma omp parallel num_threads(n_threads)
+        {
+            int thread = 0;
+#ifdef _OPENMP
+            thread = omp_get_thread_num();
+#endif
+            int begin = (int)((long long)count * thread / n_threads);
+            int end = (int)((long long)count * (thread + 1) / n_threads);
+
+            // count the elements of the slice with each value of the byte
+            int *offset = histogram[thread];
+            memset(offset, 0, 256 * sizeof(int));
+            for (int i = begin; i < end; i++) {
+                offset[(((uint32_t)src[i] ^ flip) >> shift) & 0xFF]++;
+            }
+
+#pragma omp barrier
+#pragma omp single
+            {
+                // position of the first element of each slice with each value of the byte
+                for (int v = 0, sum = 0; v < 256; v++) {
+                    for (int t = 0; t < n_threads; t++) {
+                        int n_elements = histogram[t][v];
+                        histogram[t][v] = sum;
+                        sum += n_elements;
+                    }
+                    // a byte that is the same in all elements does not change the order
+                    if (sum - histogram[0][v] == count) skip = 1;
+                }
+            }
+
+            if (!skip) {
+                for (int i = begin; i < end; i++) {
+                    uint32_t digit = (((uint32_t)src[i] ^ flip) >> shift) & 0xFF;
+                    dst[offset[digit]++] = src[i];
+                }
+            }
+        }
+
+        if (!skip) {
+            int *swap = src;
+            src = dst;
+            dst = swap;
+        }
+    }
+
+    // an odd number of passes leaves the sorted elements in the buffer
+    if (src != arr) memcpy(arr, src, count * sizeof(int));
+}
+
+/**
+ *  \brief Sorts a small integer array in the desired order with an insertion sort.
+ *
+ *  \param arr array to be sorted
+ *  \param count number of elements in the array
+ *  \param flip 0 for ascending order, -1 for descending order
+ */
+static void insertion_sort(int *arr, int count, int flip) {
+    for (int i = 1; i < count; i++) {
+        int value = arr[i], j = i;
+        for (; j > 0 && (arr[j - 1] ^ flip) > (value ^ flip); j--) {
+            arr[j] = arr[j - 1];
+        }
+        arr[j] = value;
+    }
+}
+
+/**
+ *  \brief Moves an element of a heap down until its children come before it.
+ *
+ *  \param arr array with the heap
+ *  \param count number of elements in the heap
+ *  \param index index of the element
+ *  \param flip 0 for ascending order, -1 for descending order
+ */
+static void sift_down(int *arr, int count, int index, int flip) {
+    int value = arr[index];
+    for (int child; (child = 2 * index + 1) < count; index = child) {
+        if (child + 1 < count && (arr[child + 1] ^ flip) > (arr[child] ^ flip)) child++;
+        if ((arr[child] ^ flip) <= (value ^ flip)) break;
+        arr[index] = arr[child];
+    }
+    arr[index] = value;
+}
+
+/**
+ *  \brief Sorts an integer array in the desired order with a heapsort.
+ *
+ *  \param arr array to be sorted
+ *  \param count number of elements in the array
+ *  \param flip 0 for ascending order, -1 for descending order
+ */
+static void heap_sort(int *arr, int count, int flip) {
+    for (int i = count / 2 - 1; i >= 0; i--) {
+        sift_down(arr, count, i, flip);
+    }
+    for (int i = count - 1; i > 0; i--) {
+        int temp = arr[0];
+        arr[0] = arr[i];
+        arr[i] = temp;
+        sift_down(arr, i, 0, flip);
+    }
+}
+
+/**
+ *  \brief Sorts an integer array with a quicksort, falling back to a heapsort after too many bad partitions.
+ *
+ *  \param arr array to be sorted
+ *  \param count number of elements in the array
+ *  \param depth number of partitions left before falling back to the heapsort
+ *  \param flip 0 for ascending order, -1 for descending order
+ */
+static void intro_sort_range(int *arr, int count, int depth, int flip) {  // NOLINT(*-no-recursion)
+    while (count > INSERTION_SORT_SIZE) {
+        if (depth-- == 0) {
+            heap_sort(arr, count, flip);
+            return;
+        }
+
+        // median of the first, middle and last elements as the pivot
+        int a = arr[0] ^ flip, b = arr[count / 2] ^ flip, c = arr[count - 1] ^ flip;
+        int pivot = a < b ? (b < c ? b : (a < c ? c : a)) : (a < c ? a : (b < c ? c : b));
+
+        // hoare partition, with the flipped keys
+        int i = -1, j = count;
+        while (1) {
+            while ((arr[++i] ^ flip) < pivot) {}
+            while ((arr[--j] ^ flip) > pivot) {}
+            if (i >= j) break;
+            int temp = arr[i];
+            arr[i] = arr[j];
+            arr[j] = temp;
+        }
+
+        // recurse into the smaller side and loop on the larger one, to bound the stack depth
+        // large sides are left as tasks for the other threads
+        if (j + 1 < count - j - 1) {
+#pragma omp task if (j + 1 > INTRO_TASK_SIZE)
+            intro_sort_range(arr, j + 1, depth, flip);
+            arr += j + 1;
+            count -= j + 1;
+        }
+        else {
+#pragma omp task if (count - j - 1 > INTRO_TASK_SIZE)
+            intro_sort_range(arr + j + 1, count - j - 1, depth, flip);
+            count = j + 1;
+        }
+    }
+    insertion_sort(arr, count, flip);
+}
+
+/**
+ *  \brief Sorts an integer array in the desired order with an introsort.
+ *
+ *  The sides of the partitions are sorted as tasks, shared among the threads.
+ *
+ *  \param arr array to be sorted
+ *  \param count number of elements in the array
+ *  \param direction 0 for descending order, 1 for ascending order
+ */
+void intro_sort(int *arr, int count, int direction) {
+    // flipping all bits reverses the order, so both directions are sorted with the same comparisons
+    int flip = direction == ASCENDING ? 0 : -1;
+
+    // fall back to the heapsort after 2 * log2(count) partitions
+    int depth = 0;
+    for (int n = count; n > 1; n /= 2) depth += 2;
+
+    // one thread starts the sort, the others pick up its tasks
+#pragma omp parallel
+#pragma omp single
+    intro_sort_range(arr, count, depth, flip);
+}
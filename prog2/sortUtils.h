@@ -3,7 +3,7 @@
  *
  *  \brief Assignment 2.2: mpi-based bitonic sort.
  *
- *  This file contains the interface of the bitonic sort and merge routines.
+ *  This file contains the interface of the bitonic sort and merge routines, and of the local sorts.
  *
  *  \author João Fonseca
  *  \author Rafael Gonçalves
@@ -32,4 +32,73 @@ extern void bitonic_merge(int *arr, int low_index, int count, int direction);
  */
 extern void bitonic_sort(int *arr, int low_index, int count, int direction);
 
+/** \brief State of a merge-split whose remote block may arrive in pieces */
+typedef struct {
+    const int *local;  /**< local block, sorted */
+    const int *remote; /**< block received from the partner process, sorted in the same direction */
+    int *merged;       /**< where the kept half is stored */
+    int count;         /**< number of elements in each block */
+    int keep_high;     /**< 1 to keep the largest elements, 0 to keep the smallest */
+    int from_front;    /**< 1 if the kept elements are at the front of both blocks, 0 if at the back */
+    int n_local;       /**< number of local elements already merged */
+    int n_remote;      /**< number of remote elements already merged */
+} merge_split_state;
+
+/**
+ *  \brief Keeps the largest or the smallest half of two sorted blocks, in linear time.
+ *
+ *  \param local local block, sorted in the given direction
+ *  \param remote block received from the partner process, sorted in the same direction
+ *  \param merged where the kept half is stored, sorted in the same direction
+ *  \param count number of elements in each block
+ *  \param keep_high 1 to keep the largest elements, 0 to keep the smallest
+ *  \param direction 0 for descending order, 1 for ascending order
+ */
+extern void merge_split(const int *local, const int *remote, int *merged, int count, int keep_high, int direction);
+
+/**
+ *  \brief Starts a merge-split whose remote block arrives in pieces.
+ *
+ *  The remote block must arrive starting from the end given by state->from_front (the front if 1, the back if 0).
+ *
+ *  \param state state of the merge-split
+ *  \param local local block, sorted in the given direction
+ *  \param remote block received from the partner process, sorted in the same direction
+ *  \param merged where the kept half is stored, sorted in the same direction
+ *  \param count number of elements in each block
+ *  \param keep_high 1 to keep the largest elements, 0 to keep the smallest
+ *  \param direction 0 for descending order, 1 for ascending order
+ */
+extern void merge_split_begin(merge_split_state *state, const int *local, const int *remote, int *merged, int count,
+                              int keep_high, int direction);
+
+/**
+ *  \brief Continues a merge-split as far as the remote elements that already arrived allow.
+ *
+ *  \param state state of the merge-split
+ *  \param n_available number of remote elements that already arrived, counted from the end where the merge starts
+ *
+ *  \return 1 if the merge-split is finished, 0 otherwise
+ */
+extern int merge_split_advance(merge_split_state *state, int n_available);
+
+/**
+ *  \brief Sorts an integer array in the desired order with a least significant digit radix sort.
+ *
+ *  \param arr array to be sorted
+ *  \param temp buffer with room for count elements
+ *  \param count number of elements in the array
+ *  \param direction 0 for descending order, 1 for ascending order
+ */
+extern void radix_sort(int *arr, int *temp, int count, int direction);
+
+/**
+ *  \brief Sorts an integer array in the desired order with an introsort.
+ *
+ *  \param arr array to be sorted
+ *  \param count number of elements in the array
+ *  \param direction 0 for descending order, 1 for ascending order
+ */
+extern void intro_sort(int *arr, int count, int direction);
+
 #endif /* SORT_UTILS_H */